@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "math/vecmath.hpp"
+#include "lib/consolelog.hpp"
+
+// L-BFGS with backtracking (Armijo) line search
+// loss returns function value and writes gradient to its second argument
+// step: length of the first trial step
+vec3f optimize_lbfgs(vec3f initial, std::function<double(vec3f, vec3f&)> loss, double step)
+{
+	const int m = 5; // number of correction pairs kept
+	std::vector<vec3f> S, Y;
+	vec3f x = initial;
+	vec3f g;
+	double f = loss(x, g);
+	for (int iter=0; iter<100; ++iter) {
+		// two-loop recursion for search direction d = -H g
+		vec3f q = g;
+		std::vector<double> alpha(S.size());
+		for (int i=S.size()-1; i>=0; --i) {
+			alpha[i] = dot(S[i], q) / dot(Y[i], S[i]);
+			q -= alpha[i] * Y[i];
+		}
+		if (!S.empty())
+			q *= dot(S.back(), Y.back()) / sqrlen(Y.back());
+		else if (sqrlen(g) > 0)
+			q *= step / norm(g);
+		for (int i=0; i<S.size(); ++i) {
+			double beta = dot(Y[i], q) / dot(Y[i], S[i]);
+			q += (alpha[i] - beta) * S[i];
+		}
+		vec3f d = -q;
+		if (!(dot(d, g) < 0)) {
+			// not a descent direction: restart from steepest descent
+			S.clear();
+			Y.clear();
+			if (sqrlen(g) == 0) break;
+			d = -g * (step / norm(g));
+		}
+		// backtracking line search
+		double t = 1;
+		vec3f x1, g1;
+		double f1;
+		bool accepted = false;
+		for (int k=0; k<30; ++k, t/=2) {
+			x1 = x + t * d;
+			f1 = loss(x1, g1);
+			if (f1 <= f + 1e-4 * t * dot(g, d)) {
+				accepted = true;
+				break;
+			}
+		}
+		if (!accepted) break;
+		double improve = f - f1;
+		vec3f s = x1 - x, y = g1 - g;
+		if (dot(s, y) > 1e-12 * sqrlen(y)) {
+			S.push_back(s);
+			Y.push_back(y);
+			if (S.size() > m) {
+				S.erase(S.begin());
+				Y.erase(Y.begin());
+			}
+		}
+		x = x1;
+		f = f1;
+		g = g1;
+		if (improve < 1e-6) break;
+	}
+	return x;
+}
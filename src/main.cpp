@@ -1,11 +1,13 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
 #include "rtcore/objmesh.hpp"
 #include "visualize.hpp"
 #include "mesh_test.hpp"
 #include "util.hpp"
 #include "pointset.hpp"
 #include "sphere_set_approximate.hpp"
+#include "threadpool.hpp"
 #include "lib/argparse.h"
 
 static const char *const usage[] = {
@@ -22,6 +24,16 @@ int main(int argc, const char* argv[])
 	int n_finalsample = 100000;
 	int n_mutate = 10;
 	int seed = 19260817;
+	int cache_mb = 256;
+	int n_threads = std::thread::hardware_concurrency();
+	const char *fit = "powell";
+	int fit_compare = 0;
+	int fast_math = 0;
+	float assign_tol = 0;
+	int voxel_res = 0;
+	float sov_tol = 0;
+	int lookahead = 1;
+	int assign_mb = 0;
 	const char *objpath = NULL;
 	const char *manifoldpath = NULL;
 
@@ -37,6 +49,16 @@ int main(int argc, const char* argv[])
         OPT_INTEGER(0, "final", &n_finalsample, "number of final coverage samples, default=100000"),
         OPT_INTEGER(0, "mutate", &n_mutate, "number of global optima explorations, default=10"),
         OPT_INTEGER(0, "seed", &seed, "seed of random number generator"),
+        OPT_INTEGER('j', "threads", &n_threads, "number of threads, default=number of cores"),
+        OPT_INTEGER(0, "cache", &cache_mb, "memory cap of cached loss values in MiB, default=256"),
+        OPT_STRING(0, "fit", &fit, "sphere fitting method: powell or lbfgs, default=powell"),
+        OPT_BOOLEAN(0, "fit-compare", &fit_compare, "with --fit lbfgs, also fit with powell and report evaluations saved"),
+        OPT_BOOLEAN(0, "fast-math", &fast_math, "polynomial approximations in SOV, error of each triangle's SOTV below 1e-8 of sphere volume"),
+        OPT_FLOAT(0, "assign-tol", &assign_tol, "approximate SOV in point assignment within this relative tolerance, default=0 (exact)"),
+        OPT_INTEGER(0, "voxel", &voxel_res, "approximate SOV on a voxel grid of this resolution in early iterations, default=0 (exact)"),
+        OPT_FLOAT(0, "sov-tol", &sov_tol, "skip triangles whose SOV contribution provably sums to at most this, default=0 (exact)"),
+        OPT_INTEGER(0, "lookahead", &lookahead, "in point assignment, evaluate loss of this many next points of a center at once, default=1"),
+        OPT_INTEGER(0, "assign-mb", &assign_mb, "memory cap of nearest-first point lists in point assignment in MiB, reporting peak memory including uncapped SOV sweeps, default=0 (unbounded)"),
         OPT_END(),
     };
     argparse parser;
@@ -46,6 +68,20 @@ int main(int argc, const char* argv[])
 		argparse_usage(&parser);
 		return 1;
 	}
+	FitMode fit_mode;
+	if (strcmp(fit, "powell") == 0)
+		fit_mode = FIT_POWELL;
+	else if (strcmp(fit, "lbfgs") == 0)
+		fit_mode = FIT_LBFGS;
+	else {
+		argparse_usage(&parser);
+		return 1;
+	}
+	if (fit_compare && fit_mode != FIT_LBFGS)
+		console.warn("--fit-compare only applies to --fit lbfgs, ignored");
+
+	threadpool.resize(std::max(1, n_threads));
+	SOTV::fast_math = fast_math;
 
 	// load meshs
 	RTcore::Mesh mesh = RTcore::objmesh(objpath);
@@ -56,7 +92,7 @@ int main(int argc, const char* argv[])
 
 	// sphere construction
 	srand(seed);
-	auto spheres = sphere_set_approximate(mesh, manifold, n_sphere, n_innersample, n_surfacesample, n_finalsample, n_mutate);
+	auto spheres = sphere_set_approximate(mesh, manifold, n_sphere, n_innersample, n_surfacesample, n_finalsample, n_mutate, std::max(0, cache_mb), fit_mode, fit_compare, assign_tol, voxel_res, sov_tol, std::max(1, lookahead), std::max(0, assign_mb));
 
 	// output spheres
 	for (auto s: spheres)
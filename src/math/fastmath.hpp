@@ -0,0 +1,64 @@
+// polynomial approximations of inverse trigonometric functions
+//
+// Everything reduces to atan(t) for t in [0, tan(pi/8)], evaluated by its
+// Taylor series up to t^21, truncated below t^23/23 < 7e-11. Used in SOTV, they
+// keep the error of each triangle's SOTV below 1e-8 of sphere volume.
+// They are branch-light & inlinable, so loops calling them can be vectorized.
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include "math/vecmath.hpp"
+
+// atan(t) for t in [0,1], result in [0, PI/4]
+inline double fast_atan_unit(double t)
+{
+	// atan(t) = PI/4 + atan((t-1)/(t+1))
+	const double tan_pi_8 = 0.41421356237309503;
+	bool shift = t > tan_pi_8;
+	if (shift) t = (t-1) / (t+1);
+	double t2 = t*t;
+	double s = 1.0/21;
+	s = 1.0/19 - t2*s;
+	s = 1.0/17 - t2*s;
+	s = 1.0/15 - t2*s;
+	s = 1.0/13 - t2*s;
+	s = 1.0/11 - t2*s;
+	s = 1.0/9 - t2*s;
+	s = 1.0/7 - t2*s;
+	s = 1.0/5 - t2*s;
+	s = 1.0/3 - t2*s;
+	s = 1.0 - t2*s;
+	return t*s + (shift? PI/4: 0.0);
+}
+
+inline double fast_atan2(double y, double x)
+{
+	double ax = std::abs(x), ay = std::abs(y);
+	double mx = std::max(ax, ay), mn = std::min(ax, ay);
+	if (mx == 0) return 0;
+	double a = fast_atan_unit(mn / mx);
+	if (ay > ax) a = PI/2 - a;
+	if (x < 0) a = PI - a;
+	return (y < 0)? -a: a;
+}
+
+inline double fast_atan(double x)
+{
+	return fast_atan2(x, 1.0);
+}
+
+// argument is clamped to [-1,1]
+inline double fast_asin(double x)
+{
+	x = std::max(-1.0, std::min(1.0, x));
+	return fast_atan2(x, std::sqrt((1-x) * (1+x)));
+}
+
+// argument is clamped to [-1,1]
+inline double fast_acos(double x)
+{
+	x = std::max(-1.0, std::min(1.0, x));
+	return fast_atan2(std::sqrt((1-x) * (1+x)), x);
+}
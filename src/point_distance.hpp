@@ -0,0 +1,205 @@
+// squared distances between points & centers, on SoA buffers
+//
+// Kernels process 8 points per step as vector lanes (compiled for avx512f / avx2 / default),
+// scalar tails handle the rest. Kernels over many centers walk the points in blocks that stay
+// in L1 cache while all centers pass over them. Distances are computed as sqrlen(p - c), and
+// sqrt is correctly rounded, so results & ties agree with the scalar loops they replace.
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "math/vecmath.hpp"
+#include "pointset.hpp"
+#include "sphere.hpp"
+
+// the avx2 / avx512f clones may fuse multiply & add, the baseline code they replace doesn't
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+
+// coordinates of points in separate arrays
+struct PointSoA
+{
+	std::vector<double> x, y, z;
+
+	PointSoA() {}
+	PointSoA(const PointSet& points)
+	{
+		for (auto p: points)
+			push_back(p);
+	}
+
+	void push_back(vec3f p)
+	{
+		x.push_back(p.x);
+		y.push_back(p.y);
+		z.push_back(p.z);
+	}
+
+	int size() const
+	{
+		return x.size();
+	}
+
+	vec3f operator[](int i) const
+	{
+		return vec3f(x[i], y[i], z[i]);
+	}
+};
+
+namespace point_distance
+{
+	const int W = 8;
+	typedef double vdouble __attribute__((vector_size(W * sizeof(double))));
+	// points per block of kernels over many centers: 3 * 512 doubles fit in L1 cache
+	const int block = 512;
+}
+
+// index of point farthest from c (first one if tied), -1 if there is none
+// sqrd: if given, set to its squared distance (0 if there is none)
+__attribute__((target_clones("avx512f", "avx2", "default")))
+int farthest(const PointSoA& p, vec3f c, double* sqrd = NULL)
+{
+	using namespace point_distance;
+	const int n = p.size();
+	// per lane maximum & its index, lanes hold points i+k
+	vdouble best = vdouble{} - 1;
+	vdouble best_index = vdouble{} - 1;
+	int i = 0;
+	for (; i+W <= n; i += W) {
+		vdouble dx, dy, dz, index;
+		for (int k=0; k<W; ++k) {
+			dx[k] = p.x[i+k] - c.x;
+			dy[k] = p.y[i+k] - c.y;
+			dz[k] = p.z[i+k] - c.z;
+			index[k] = i+k;
+		}
+		vdouble d = dx*dx + dy*dy + dz*dz;
+		auto greater = d > best;
+		best = greater? d: best;
+		best_index = greater? index: best_index;
+	}
+	// reduce lanes, smaller index on ties
+	double bestd = -1;
+	int besti = -1;
+	for (int k=0; k<W; ++k)
+		if (best[k] > bestd || (best[k] == bestd && best_index[k] < besti))
+			bestd = best[k], besti = best_index[k];
+	for (; i<n; ++i) {
+		double d = sqrlen(p[i] - c);
+		if (d > bestd)
+			bestd = d, besti = i;
+	}
+	if (sqrd) *sqrd = std::max(0.0, bestd);
+	return besti;
+}
+
+// squared distance from each point to its nearest center
+__attribute__((target_clones("avx512f", "avx2", "default")))
+std::vector<double> min_sqrdist(const PointSoA& p, const PointSoA& center)
+{
+	using namespace point_distance;
+	const int n = p.size();
+	std::vector<double> result(n, INF);
+	for (int b=0; b<n; b+=block) {
+		int e = std::min(n, b+block);
+		for (int j=0; j<center.size(); ++j) {
+			vec3f c = center[j];
+			int i = b;
+			for (; i+W <= e; i += W) {
+				vdouble dx, dy, dz, best;
+				for (int k=0; k<W; ++k) {
+					dx[k] = p.x[i+k] - c.x;
+					dy[k] = p.y[i+k] - c.y;
+					dz[k] = p.z[i+k] - c.z;
+					best[k] = result[i+k];
+				}
+				vdouble d = dx*dx + dy*dy + dz*dz;
+				best = (d < best)? d: best;
+				for (int k=0; k<W; ++k)
+					result[i+k] = best[k];
+			}
+			for (; i<e; ++i)
+				result[i] = std::min(result[i], sqrlen(p[i] - c));
+		}
+	}
+	return result;
+}
+
+// for each point, index of first sphere containing it (norm(p - center) <= radius), -1 if none does
+__attribute__((target_clones("avx512f", "avx2", "default")))
+std::vector<int> first_within(const PointSoA& p, const std::vector<Sphere>& sphere)
+{
+	using namespace point_distance;
+	const int n = p.size();
+	std::vector<int> result(n, -1);
+	for (int b=0; b<n; b+=block) {
+		int e = std::min(n, b+block);
+		// spheres in reverse, so that the first one containing a point is written last
+		for (int j=(int)sphere.size()-1; j>=0; --j) {
+			vec3f c = sphere[j].center;
+			double r = sphere[j].radius;
+			int i = b;
+			for (; i+W <= e; i += W) {
+				vdouble dx, dy, dz, d;
+				for (int k=0; k<W; ++k) {
+					dx[k] = p.x[i+k] - c.x;
+					dy[k] = p.y[i+k] - c.y;
+					dz[k] = p.z[i+k] - c.z;
+				}
+				vdouble d2 = dx*dx + dy*dy + dz*dz;
+				for (int k=0; k<W; ++k)
+					d[k] = std::sqrt(d2[k]);
+				for (int k=0; k<W; ++k)
+					if (d[k] <= r) result[i+k] = j;
+			}
+			for (; i<e; ++i)
+				if (norm(p[i] - c) <= r) result[i] = j;
+		}
+	}
+	return result;
+}
+
+// index of sphere p lies least outside of, max(0, norm(p - center) - radius) (first one if tied)
+// center & radius of spheres are given separately, so radii can be updated cheaply
+__attribute__((target_clones("avx512f", "avx2", "default")))
+int min_excess(const PointSoA& center, const std::vector<double>& radius, vec3f p)
+{
+	using namespace point_distance;
+	const int n = center.size();
+	vdouble best = vdouble{} + INF;
+	vdouble best_index = vdouble{} - 1;
+	int j = 0;
+	for (; j+W <= n; j += W) {
+		vdouble dx, dy, dz, r, index, d;
+		for (int k=0; k<W; ++k) {
+			dx[k] = p.x - center.x[j+k];
+			dy[k] = p.y - center.y[j+k];
+			dz[k] = p.z - center.z[j+k];
+			r[k] = radius[j+k];
+			index[k] = j+k;
+		}
+		vdouble d2 = dx*dx + dy*dy + dz*dz;
+		for (int k=0; k<W; ++k)
+			d[k] = std::sqrt(d2[k]);
+		vdouble excess = d - r;
+		excess = (excess > 0)? excess: vdouble{};
+		auto less = excess < best;
+		best = less? excess: best;
+		best_index = less? index: best_index;
+	}
+	double bestx = INF;
+	int bestj = -1;
+	for (int k=0; k<W; ++k)
+		if (best[k] < bestx || (best[k] == bestx && best_index[k] < bestj))
+			bestx = best[k], bestj = best_index[k];
+	for (; j<n; ++j) {
+		double excess = std::max(0.0, norm(p - center[j]) - radius[j]);
+		if (excess < bestx)
+			bestx = excess, bestj = j;
+	}
+	return bestj;
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,234 @@
+// kd-tree over a PointSet, listing points nearest first from any query point, lazily
+//
+// PointTree::Nearest is a best-first search: its heap holds subtrees keyed by the squared distance
+// to their bounding box & points keyed by their own squared distance, so points come out in order
+// and only the part of the tree reached so far is ever expanded. Floating point subtraction,
+// squaring & addition are monotonic, so a box key never exceeds the key of a point in it.
+// Ties are broken by point index: the order is that of sorting by (squared distance, index).
+// With a cap, Nearest holds no more than cap upcoming points instead: they're found by a fresh
+// branch & bound search for the cap nearest points past the last one listed, in the same order.
+// Points removed from the tree are skipped by all lists, & so are subtrees left empty.
+
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <tuple>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "math/vecmath.hpp"
+#include "pointset.hpp"
+
+class PointTree
+{
+	struct Node
+	{
+		vec3f lo, hi;   // bounding box
+		int begin, end; // range of order
+		int lc = -1, rc = -1;
+		int alive;      // points not removed
+	};
+	const PointSet& points;
+	std::vector<int> order; // point indices, each node's in a contiguous range
+	std::vector<int> position; // inverse of order
+	std::vector<bool> removed_;
+	std::vector<Node> nodes;
+	static const int leaf_size = 8;
+
+	static double coord(const vec3f& p, int axis)
+	{
+		return (axis == 0)? p.x: (axis == 1)? p.y: p.z;
+	}
+
+	int build(int begin, int end)
+	{
+		int id = nodes.size();
+		nodes.emplace_back();
+		Node node;
+		node.begin = begin;
+		node.end = end;
+		node.alive = end - begin;
+		node.lo = node.hi = points[order[begin]];
+		for (int k=begin+1; k<end; ++k) {
+			const vec3f& p = points[order[k]];
+			node.lo = vec3f(std::min(node.lo.x, p.x), std::min(node.lo.y, p.y), std::min(node.lo.z, p.z));
+			node.hi = vec3f(std::max(node.hi.x, p.x), std::max(node.hi.y, p.y), std::max(node.hi.z, p.z));
+		}
+		if (end - begin > leaf_size) {
+			// split at median of longest side
+			vec3f size = node.hi - node.lo;
+			int axis = (size.x >= size.y && size.x >= size.z)? 0: (size.y >= size.z)? 1: 2;
+			int mid = (begin + end) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b){
+				return coord(points[a], axis) < coord(points[b], axis);
+			});
+			node.lc = build(begin, mid);
+			node.rc = build(mid, end);
+		}
+		nodes[id] = node;
+		return id;
+	}
+
+public:
+	// the tree refers to points, which must outlive it
+	PointTree(const PointSet& points): points(points), order(points.size()), position(points.size()), removed_(points.size(), false)
+	{
+		std::iota(order.begin(), order.end(), 0);
+		if (!points.empty())
+			build(0, points.size());
+		for (int k=0; k<order.size(); ++k)
+			position[order[k]] = k;
+	}
+
+	// removes point i from all lists, including the ones already started
+	void remove(int i)
+	{
+		if (removed_[i]) return;
+		removed_[i] = true;
+		for (int id=0; id>=0; ) {
+			Node& node = nodes[id];
+			node.alive--;
+			id = (node.lc < 0)? -1: (position[i] < nodes[node.lc].end)? node.lc: node.rc;
+		}
+	}
+
+	bool removed(int i) const
+	{
+		return removed_[i];
+	}
+
+	// points in order of distance to q
+	class Nearest
+	{
+		const PointTree* tree;
+		vec3f q;
+		// (squared distance, 0 for node or 1 for point, node or point index)
+		// at equal distance nodes come first, as they may hold points of smaller index
+		typedef std::tuple<double, int, int> Item;
+		std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+		// bounded: (squared distance, point index) of upcoming points, farthest first, & of last one listed
+		typedef std::pair<double, int> Key;
+		int cap;
+		std::vector<Key> upcoming;
+		Key last = {-1, -1};
+
+		double sqrdistance(const Node& node) const
+		{
+			vec3f d(std::max({node.lo.x - q.x, q.x - node.hi.x, 0.0}),
+			        std::max({node.lo.y - q.y, q.y - node.hi.y, 0.0}),
+			        std::max({node.lo.z - q.z, q.z - node.hi.z, 0.0}));
+			return sqrlen(d);
+		}
+
+		// squared distance to farthest point of node's box
+		double max_sqrdistance(const Node& node) const
+		{
+			vec3f d(std::max(std::abs(node.lo.x - q.x), std::abs(node.hi.x - q.x)),
+			        std::max(std::abs(node.lo.y - q.y), std::abs(node.hi.y - q.y)),
+			        std::max(std::abs(node.lo.z - q.z), std::abs(node.hi.z - q.z)));
+			return sqrlen(d);
+		}
+
+		// collects in best (a max-heap) the cap nearest points of subtree id past last
+		void search(int id, std::priority_queue<Key>& best) const
+		{
+			const Node& node = tree->nodes[id];
+			if (node.alive == 0 || max_sqrdistance(node) < last.first)
+				return; // all removed or listed
+			if ((int)best.size() == cap && sqrdistance(node) > best.top().first)
+				return; // none nearer
+			if (node.lc < 0) {
+				for (int k=node.begin; k<node.end; ++k) {
+					int i = tree->order[k];
+					if (tree->removed_[i])
+						continue;
+					Key key(sqrlen(tree->points[i] - q), i);
+					if (key <= last || ((int)best.size() == cap && key >= best.top()))
+						continue;
+					best.push(key);
+					if ((int)best.size() > cap)
+						best.pop();
+				}
+				return;
+			}
+			int near = node.lc, far = node.rc;
+			if (sqrdistance(tree->nodes[far]) < sqrdistance(tree->nodes[near]))
+				std::swap(near, far);
+			search(near, best);
+			search(far, best);
+		}
+
+	public:
+		// bytes held per upcoming point in bounded mode
+		static const size_t item_bytes = sizeof(Key);
+
+		// cap: if positive, upcoming points held at a time
+		Nearest(const PointTree& tree, vec3f q, int cap = 0): tree(&tree), q(q), cap(cap)
+		{
+			if (!tree.nodes.empty() && cap <= 0)
+				heap.push({sqrdistance(tree.nodes[0]), 0, 0});
+		}
+
+		// index of next nearest point, -1 once all points are listed
+		int next()
+		{
+			if (cap > 0) {
+				while (true) {
+					if (upcoming.empty() && !tree->nodes.empty()) {
+						std::priority_queue<Key> best;
+						search(0, best);
+						for (; !best.empty(); best.pop())
+							upcoming.push_back(best.top());
+					}
+					if (upcoming.empty())
+						return -1;
+					last = upcoming.back();
+					upcoming.pop_back();
+					if (!tree->removed_[last.second])
+						return last.second;
+				}
+			}
+			while (!heap.empty()) {
+				auto [d, is_point, id] = heap.top();
+				heap.pop();
+				if (is_point) {
+					if (tree->removed_[id]) continue;
+					return id;
+				}
+				const Node& node = tree->nodes[id];
+				if (node.alive == 0)
+					continue;
+				if (node.lc < 0) {
+					for (int k=node.begin; k<node.end; ++k) {
+						int i = tree->order[k];
+						if (!tree->removed_[i])
+							heap.push({sqrlen(tree->points[i] - q), 1, i});
+					}
+				}
+				else {
+					heap.push({sqrdistance(tree->nodes[node.lc]), 0, node.lc});
+					heap.push({sqrdistance(tree->nodes[node.rc]), 0, node.rc});
+				}
+			}
+			return -1;
+		}
+
+		// bytes held for upcoming points
+		size_t bytes() const
+		{
+			return heap.size() * sizeof(Item) + upcoming.capacity() * sizeof(Key);
+		}
+	};
+
+	Nearest nearest(vec3f q, int cap = 0) const
+	{
+		return Nearest(*this, q, cap);
+	}
+
+	// bytes held by the tree, besides the points
+	size_t bytes() const
+	{
+		return (order.capacity() + position.capacity()) * sizeof(int) + removed_.capacity() / 8 + nodes.capacity() * sizeof(Node);
+	}
+};
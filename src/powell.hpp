@@ -3,6 +3,7 @@
 #include <functional>
 #include <algorithm>
 #include <vector>
+#include <numeric>
 #include "math/vecmath.hpp"
 #include "lib/consolelog.hpp"
 #include "util.hpp"
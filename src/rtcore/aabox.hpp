@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cfloat>
+#include <algorithm>
 #include "ray.hpp"
 
 namespace RTcore
@@ -61,6 +63,41 @@ struct AABox
 		t = tmin;
 		return true;
 	}
+	// whether the box touches the ball of radius r centered at o
+	// float bounds are padded by their rounding error, so that no touching box is rejected
+	bool intersect(const point& o, double r) const
+	{
+		return sqrdistance(o) <= r*r;
+	}
+	// squared distance from p to the box, padded as in intersect() so that it's never overestimated
+	double sqrdistance(const point& p) const
+	{
+		auto axis = [](double lo, double hi, double p) {
+			lo -= std::abs(lo) * FLT_EPSILON;
+			hi += std::abs(hi) * FLT_EPSILON;
+			if (p < lo) return lo - p;
+			if (p > hi) return p - hi;
+			return 0.0;
+		};
+		double dx = axis(x1, x2, p.x);
+		double dy = axis(y1, y2, p.y);
+		double dz = axis(z1, z2, p.z);
+		return dx*dx + dy*dy + dz*dz;
+	}
+	// whether the box lies inside the ball of radius r centered at o
+	// float bounds are padded by their rounding error, so that no box reaching out is accepted
+	bool inside(const point& o, double r) const
+	{
+		auto axis = [](double lo, double hi, double p) {
+			lo -= std::abs(lo) * FLT_EPSILON;
+			hi += std::abs(hi) * FLT_EPSILON;
+			return std::max(p - lo, hi - p);
+		};
+		double dx = axis(x1, x2, o.x);
+		double dy = axis(y1, y2, o.y);
+		double dz = axis(z1, z2, o.z);
+		return dx*dx + dy*dy + dz*dz <= r*r;
+	}
 	float surfaceArea() {
 		float dx = x2 - x1;
 		float dy = y2 - y1;
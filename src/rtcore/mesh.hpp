@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include "aabox.hpp"
 #include "triangle.hpp"
 #include "lib/consolelog.hpp"
@@ -23,11 +25,25 @@ class Mesh
 	};
 public:
 	std::vector<Triangle*> list;
+
+	// sums over primitives of subtrees lying inside a ball, seen from its center o
+	// triangles are taken with vertices ordered counterclockwise around planeNormal
+	struct InnerSum {
+		double solid_angle = 0; // signed, as solidAngle()
+		double volume = 0;      // of cones from o, signed by side of plane o lies in
+		vec3f area_normal;      // area-weighted normals
+	};
 	
 	Mesh(const std::vector<Triangle*>& list): list(list)
 	{
 		console.log("building SAH BVH of", list.size(), "primitives");
 		build(list, root);
+		// leaves remember position of their primitive in list
+		std::unordered_map<Triangle*, int> index;
+		for (int i=0; i<list.size(); ++i)
+			index[list[i]] = i;
+		assign_index(root, index);
+		build_inner_sum(root);
 		bound = list[0]->boundingVolume();
 		for (int i=1; i<list.size(); ++i) {
 			bound = bound + list[i]->boundingVolume();
@@ -48,6 +64,65 @@ public:
 		return treehit_all(ray, root);
 	}
 	 
+	// indices (ascending) of primitives whose bounding box touches the ball
+	// if solid_angle is given, adds the solid angle of all other primitives seen from o
+	std::vector<int> intersect_sphere(const vec3f& o, double r, double* solid_angle = NULL) const
+	{
+		std::vector<int> result;
+		treehit_sphere(o, r, root, result, solid_angle);
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	// like intersect_sphere(), but primitives under subtrees lying inside the ball and away from o
+	// aren't listed, their sums are added to inner instead
+	// indices are in order of BVH leaves (not sorted, which would take as long as the traversal)
+	std::vector<int> intersect_sphere(const vec3f& o, double r, double* solid_angle, InnerSum& inner) const
+	{
+		std::vector<int> result;
+		treehit_sphere(o, r, root, result, solid_angle, &inner);
+		return result;
+	}
+
+	// intersect_sphere() with inner sums for many balls in a single traversal, nodes are visited
+	// once for all balls touching them. solid_angle & inner are indexed by ball like the result,
+	// which is the same as from intersect_sphere() of each ball
+	std::vector<std::vector<int>> intersect_spheres(const std::vector<vec3f>& o, const std::vector<double>& r,
+		std::vector<double>& solid_angle, std::vector<InnerSum>& inner) const
+	{
+		std::vector<std::vector<int>> result(o.size());
+		std::vector<int> active(o.size());
+		for (int k=0; k<o.size(); ++k)
+			active[k] = k;
+		treehit_spheres(o, r, root, active, 0, active.size(), result, solid_angle, inner);
+		return result;
+	}
+
+	// distance from p to nearest primitive, if it's below limit (otherwise limit is returned)
+	// nearest: if given, set to index of the nearest primitive, -1 if none is below limit
+	double distance(const vec3f& p, double limit = INF, int* nearest = NULL) const
+	{
+		double best = limit;
+		int index = -1;
+		if (root->bound.sqrdistance(p) < limit * limit)
+			treenearest(p, root, best, index);
+		if (nearest) *nearest = index;
+		return best;
+	}
+
+	// volume enclosed by closed mesh, with normals pointing outward
+	double volume() const
+	{
+		return root->det_sum / 6;
+	}
+
+	// generalized winding number: ~1 inside closed mesh, ~0 outside
+	// exact: sum solid angles of all primitives, instead of approximating distant subtrees
+	double winding_number(const vec3f& p, bool exact = false) const
+	{
+		return treesolidangle(p, root, exact) / (4*PI);
+	}
+	 
 	AABox boundingVolume() const
 	{
 		return bound;
@@ -66,8 +141,24 @@ private:
 		treenode* lc = NULL;
 		treenode* rc = NULL;
 		Triangle* shape = NULL;
+		int index = -1; // position of shape in list
 		AABox bound;
+		// dipole of subtree for far field solid angle:
+		// sum of area-weighted normal, area-weighted centroid & radius around it
+		vec3f area_normal;
+		vec3f centroid;
+		double area = 0;
+		double extent = 0;
+		// for sums over subtree lying in a ball, with triangles ordered counterclockwise:
+		// sum of det(v1,v2,v3), so that 6 * volume of cones from o is det_sum - dot(o, 2*area_normal)
+		double det_sum = 0;
+		// edges left after cancelling opposite ones, solid angle of subtree is that of their fan from
+		// boundary[0].first, for o outside bound. only kept if shorter than half number of triangles
+		std::vector<std::pair<vec3f,vec3f>> boundary;
+		bool aggregated = false;
 	};
+	// subtrees are approximated by their dipole beyond this many times of their extent
+	static constexpr double far_field_ratio = 2;
 	treenode* root = NULL;
 
 	void build(std::vector<Triangle*> list, treenode*& cur)
@@ -79,8 +170,13 @@ private:
 		// bind shape to leaf nodes
 		if (list.size() == 1)
 		{
-			cur->shape = list[0];
-			cur->bound = list[0]->boundingVolume();
+			Triangle* t = list[0];
+			cur->shape = t;
+			cur->bound = t->boundingVolume();
+			cur->area = t->surfaceArea();
+			cur->area_normal = cur->area * t->planeNormal;
+			cur->centroid = (t->v1 + t->v2 + t->v3) / 3;
+			cur->extent = std::max({norm(t->v1 - cur->centroid), norm(t->v2 - cur->centroid), norm(t->v3 - cur->centroid)});
 			return;
 		}
 		// compute bounding box
@@ -130,6 +226,73 @@ private:
 		// recursive partition
 		build(std::vector<Triangle*>(list.begin(), list.begin()+best+1), cur->lc);
 		build(std::vector<Triangle*>(list.begin()+best+1, list.end()), cur->rc);
+		// merge dipoles of children
+		treenode *lc = cur->lc, *rc = cur->rc;
+		cur->area = lc->area + rc->area;
+		cur->area_normal = lc->area_normal + rc->area_normal;
+		cur->centroid = (lc->area * lc->centroid + rc->area * rc->centroid) / cur->area;
+		cur->extent = std::max(norm(lc->centroid - cur->centroid) + lc->extent, norm(rc->centroid - cur->centroid) + rc->extent);
+	}
+
+	void assign_index(treenode* node, const std::unordered_map<Triangle*, int>& index)
+	{
+		if (node == NULL) return;
+		if (node->shape != NULL)
+			node->index = index.at(node->shape);
+		assign_index(node->lc, index);
+		assign_index(node->rc, index);
+	}
+
+	// computes det_sum & boundary of subtree, returns number of primitives
+	int build_inner_sum(treenode* node)
+	{
+		if (node->shape != NULL) {
+			Triangle* t = node->shape;
+			vec3f v1 = t->v1, v2 = t->v2, v3 = t->v3;
+			if (dot(cross(v2-v1, v3-v1), t->planeNormal) < 0)
+				std::swap(v2, v3);
+			node->det_sum = dot(v1, cross(v2, v3));
+			node->boundary = {{v1,v2}, {v2,v3}, {v3,v1}};
+			return 1;
+		}
+		int n = build_inner_sum(node->lc) + build_inner_sum(node->rc);
+		node->det_sum = node->lc->det_sum + node->rc->det_sum;
+		// merge boundaries, cancelling edges shared by both children
+		auto less = [](const vec3f& a, const vec3f& b) {
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		};
+		struct Edge { vec3f a, b; int dir; };
+		std::vector<Edge> edges;
+		for (treenode* c: {node->lc, node->rc})
+			for (auto& e: c->boundary) {
+				if (less(e.first, e.second))
+					edges.push_back({e.first, e.second, 1});
+				else
+					edges.push_back({e.second, e.first, -1});
+			}
+		std::sort(edges.begin(), edges.end(), [&](const Edge& e, const Edge& f) {
+			if (!(e.a == f.a)) return less(e.a, f.a);
+			return less(e.b, f.b);
+		});
+		for (int i=0, j; i<edges.size(); i=j) {
+			int count = 0;
+			for (j=i; j<edges.size() && edges[j].a == edges[i].a && edges[j].b == edges[i].b; ++j)
+				count += edges[j].dir;
+			for (; count > 0; --count)
+				node->boundary.push_back({edges[i].a, edges[i].b});
+			for (; count < 0; ++count)
+				node->boundary.push_back({edges[i].b, edges[i].a});
+		}
+		// children only need their boundary if aggregated themselves
+		for (treenode* c: {node->lc, node->rc})
+			if (!c->aggregated)
+				std::vector<std::pair<vec3f,vec3f>>().swap(c->boundary);
+		node->aggregated = node->boundary.size() * 2 < n;
+		if (node == root && !node->aggregated)
+			std::vector<std::pair<vec3f,vec3f>>().swap(node->boundary);
+		return n;
 	}
 
 	HitTmp treehit(const Ray& ray, treenode* node) const {
@@ -159,6 +322,102 @@ private:
 		resl.insert(resl.end(), resr.begin(), resr.end());
 		return resl;
 	}
+
+	void treehit_sphere(const vec3f& o, double r, treenode* node, std::vector<int>& result, double* solid_angle, InnerSum* inner = NULL) const {
+		if (node == NULL) return;
+		if (!node->bound.intersect(o, r)) {
+			if (solid_angle)
+				*solid_angle += treesolidangle(o, node);
+			return;
+		}
+		if (inner && aggregate(o, r, node, *inner))
+			return;
+		if (node->shape != NULL) {
+			result.push_back(node->index);
+			return;
+		}
+		treehit_sphere(o, r, node->lc, result, solid_angle, inner);
+		treehit_sphere(o, r, node->rc, result, solid_angle, inner);
+	}
+
+	// adds sums of subtree to inner if it lies inside the ball and away from o, returns whether it does
+	bool aggregate(const vec3f& o, double r, treenode* node, InnerSum& inner) const {
+		if (!node->aggregated || !node->bound.inside(o, r) || node->bound.intersect(o, 0))
+			return false;
+		// fan of boundary from a point in bound covers same solid angle as the triangles,
+		// since o is outside of the closed surface they make up
+		double omega = 0;
+		if (!node->boundary.empty()) {
+			vec3f q = node->boundary[0].first - o;
+			for (auto& e: node->boundary)
+				omega += solid_angle_oriented(q, e.first - o, e.second - o);
+		}
+		inner.solid_angle += omega;
+		inner.volume += (node->det_sum - dot(o, 2 * node->area_normal)) / 6;
+		inner.area_normal += node->area_normal;
+		return true;
+	}
+
+	// treehit_sphere() for balls active[begin..end-1] (indices into o & r) at node
+	// active is used as a stack, balls touching node are pushed for children & popped afterwards
+	void treehit_spheres(const std::vector<vec3f>& o, const std::vector<double>& r, treenode* node, std::vector<int>& active, int begin, int end,
+		std::vector<std::vector<int>>& result, std::vector<double>& solid_angle, std::vector<InnerSum>& inner) const {
+		if (node == NULL) return;
+		int top = active.size();
+		for (int i=begin; i<end; ++i) {
+			int k = active[i];
+			if (!node->bound.intersect(o[k], r[k]))
+				solid_angle[k] += treesolidangle(o[k], node);
+			else if (!aggregate(o[k], r[k], node, inner[k]))
+				active.push_back(k);
+		}
+		int n_touch = active.size() - top;
+		if (n_touch > 0 && node->shape != NULL) {
+			for (int i=top; i<top+n_touch; ++i)
+				result[active[i]].push_back(node->index);
+		}
+		else if (n_touch > 0) {
+			treehit_spheres(o, r, node->lc, active, top, top+n_touch, result, solid_angle, inner);
+			treehit_spheres(o, r, node->rc, active, top, top+n_touch, result, solid_angle, inner);
+		}
+		active.resize(top);
+	}
+
+	// branch & bound, nodes no nearer than best are skipped
+	void treenearest(const vec3f& p, const treenode* node, double& best, int& index) const {
+		if (node->shape != NULL) {
+			double d = norm(node->shape->nearestPoint(p) - p);
+			if (d < best) {
+				best = d;
+				index = node->index;
+			}
+			return;
+		}
+		// nearer child first, so that the other one is more likely to be skipped
+		const treenode* a = node->lc;
+		const treenode* b = node->rc;
+		double da = a->bound.sqrdistance(p), db = b->bound.sqrdistance(p);
+		if (db < da) {
+			std::swap(a, b);
+			std::swap(da, db);
+		}
+		if (da < best * best)
+			treenearest(p, a, best, index);
+		if (db < best * best)
+			treenearest(p, b, best, index);
+	}
+
+	// solid angle of subtree seen from p, using dipole approximation for distant subtrees unless exact
+	double treesolidangle(const vec3f& p, treenode* node, bool exact = false) const {
+		if (node == NULL) return 0;
+		if (node->shape != NULL)
+			return node->shape->solidAngle(p);
+		vec3f d = node->centroid - p;
+		double dist = norm(d);
+		if (!exact && dist > far_field_ratio * node->extent)
+			return dot(node->area_normal, d) / (dist*dist*dist);
+		return treesolidangle(p, node->lc, exact) + treesolidangle(p, node->rc, exact);
+	}
 };
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include "aabox.hpp"
 #include "math/matmath.hpp"
 #include "sampler.hpp"
@@ -8,6 +9,22 @@
 namespace RTcore
 {
 
+// solid angle of triangle abc seen from origin, by Van Oosterom & Strackee
+inline double solid_angle(vec3f a, vec3f b, vec3f c)
+{
+	double la = norm(a), lb = norm(b), lc = norm(c);
+	double den = la*lb*lc + dot(a,b)*lc + dot(a,c)*lb + dot(b,c)*la;
+	return 2 * std::atan2(std::abs(dot(a, cross(b,c))), den);
+}
+
+// solid angle of triangle a-b-c seen from origin, negative if it's clockwise seen from origin
+inline double solid_angle_oriented(vec3f a, vec3f b, vec3f c)
+{
+	double la = norm(a), lb = norm(b), lc = norm(c);
+	double den = la*lb*lc + dot(a,b)*lc + dot(a,c)*lb + dot(b,c)*la;
+	return 2 * std::atan2(dot(a, cross(b,c)), den);
+}
+
 class Triangle
 {
 	mat3f tMatrix;
@@ -65,6 +82,37 @@ public:
 		return norm(cross(v3-v1, v2-v1))/2;
 	}
 
+	// solid angle seen from p, positive if p is behind the triangle (planeNormal pointing away)
+	double solidAngle(const point& p) const
+	{
+		double side = dot(v1-p, planeNormal);
+		int sgn = (side > 0) - (side < 0);
+		return sgn * solid_angle(v1-p, v2-p, v3-p);
+	}
+
+	// point on triangle nearest to p
+	// from Ericson, Real-Time Collision Detection, 5.1.5
+	point nearestPoint(const point& p) const
+	{
+		vec3f ab = v2-v1, ac = v3-v1, ap = p-v1;
+		double d1 = dot(ab, ap), d2 = dot(ac, ap);
+		if (d1 <= 0 && d2 <= 0) return v1;
+		vec3f bp = p-v2;
+		double d3 = dot(ab, bp), d4 = dot(ac, bp);
+		if (d3 >= 0 && d4 <= d3) return v2;
+		double vc = d1*d4 - d3*d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) return v1 + d1 / (d1-d3) * ab;
+		vec3f cp = p-v3;
+		double d5 = dot(ab, cp), d6 = dot(ac, cp);
+		if (d6 >= 0 && d5 <= d6) return v3;
+		double vb = d5*d2 - d1*d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) return v1 + d2 / (d2-d6) * ac;
+		double va = d3*d6 - d5*d4;
+		if (va <= 0 && d4-d3 >= 0 && d5-d6 >= 0) return v2 + (d4-d3) / ((d4-d3) + (d5-d6)) * (v3-v2);
+		double denom = 1 / (va + vb + vc);
+		return v1 + ab * (vb * denom) + ac * (vc * denom);
+	}
+
 	vec3f sampleSurface(Sampler& sampler) const
 	{
 		vec2f t = sampler.sampleUnitTriangle();
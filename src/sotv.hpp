@@ -5,48 +5,165 @@
 
 #include <cmath>
 #include <algorithm>
+#include <atomic>
 #include "math/vecmath.hpp"
-#include "sotv_debug.hpp"
+#include "math/fastmath.hpp"
+#include "lib/consolelog.hpp"
 
-class SOTV
+// triangle with the quantities SOTV needs that don't depend on the sphere
+struct SOTVTriangle
 {
+	vec3f v1, v2, v3;
+	vec3f unit_normal; // normalized(cross(v1-v2, v1-v3))
+	vec3f facedir;     // cross(v2-v1, v3-v2), reference orientation for point in triangle test
+	double cross_norm; // norm(cross(v2-v1, v3-v1)), twice the area
+	double l12, l23, l31; // squared edge lengths
+
+	SOTVTriangle() {}
+	SOTVTriangle(vec3f v1, vec3f v2, vec3f v3): v1(v1), v2(v2), v3(v3)
+	{
+		unit_normal = normalized(cross(v1-v2, v1-v3));
+		facedir = cross(v2-v1, v3-v2);
+		cross_norm = norm(cross(v2-v1, v3-v1));
+		l12 = sqrlen(v1-v2);
+		l23 = sqrlen(v2-v3);
+		l31 = sqrlen(v3-v1);
+	}
+};
+
+// number of degenerate cases met by SOTV, summed over all threads
+struct SOTVStats
+{
+	std::atomic<long long> tangent{0};   // segment sphere intersection missed by rounding, clamped
+	std::atomic<long long> nonfinite{0}; // inf or nan result, replaced by 0
+	std::atomic<long long> zero_sign{0}; // center on plane of triangle, SOTV not accumulated
+
+	long long total() const
+	{
+		return tangent + nonfinite + zero_sign;
+	}
+};
+
+SOTVStats sotv_stats;
+
+// tracing policies of SOTVKernel, called with intermediate results & on degenerate cases
+// SOTVQuiet compiles to nothing, SOTVTrace logs them & throws on degenerate cases
+struct SOTVQuiet
+{
+	static constexpr bool throws = false;
+	template <class... Args>
+	static void log(const Args&...) {}
+	static void fail(const char*) {}
+};
+
+struct SOTVTrace
+{
+	static constexpr bool throws = true;
+	template <class... Args>
+	static void log(const Args&... args)
+	{
+		console.log(args...);
+	}
+	static void fail(const char* what)
+	{
+		throw what;
+	}
+};
+
+// shared by all instantiations of SOTVKernel
+struct SOTVBase
+{
+	enum Status
+	{
+		OK = 0,
+		TANGENT = 1,
+		NONFINITE = 2,
+	};
+
+	// use polynomial inverse trigonometric functions & trigonometric identities
+	// in solid angles and swing volumes instead of libm
+	// error of each triangle's SOTV below 1e-8 of sphere volume, checked by validation/fastmath_test.cpp
+	static inline bool fast_math = false;
+};
+
+// Degenerate cases are reported through status bits and counted in sotv_stats, so that the kernel
+// doesn't throw. Compile with -DSOTV_DEBUG to warn, rerun with debug::sotv and throw instead.
+template <class Trace>
+class SOTVKernel: public SOTVBase
+{
+	template <class> friend class SOTVKernel;
+#ifdef SOTV_DEBUG
+	static constexpr bool debug = true;
+#else
+	static constexpr bool debug = false;
+#endif
+
 public:
 	// parameters: triangle vertices, sphere center & radius
-	double operator()(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r)
+	double operator()(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r) noexcept(!debug && !Trace::throws)
+	{
+		return (*this)(SOTVTriangle(v1,v2,v3), o,r);
+	}
+
+	// parameters: triangle with precomputed invariants, sphere center & radius
+	double operator()(const SOTVTriangle& t, vec3f o, double r) noexcept(!debug && !Trace::throws)
+	{
+		unsigned status = OK;
+		double result = (*this)(t,o,r, status);
+		if (status != OK)
+			report(t,o,r, status);
+		return result;
+	}
+
+	// same as above, adding bits of degenerate cases met to status instead of reporting them
+	double operator()(const SOTVTriangle& t, vec3f o, double r, unsigned& status) noexcept(!Trace::throws)
 	{
-		double result = sotv(v1,v2,v3,o,r);
-		if (isinf(result) or isnan(result)) {
-			console.warn("SOTV exceptional result:", result);
-			console.warn("arg:",v1,v2,v3,o,r);
-			debug::sotv(v1,v2,v3,o,r);
-			throw "1";
+		Trace::log("========= SOTV entering debug mode =========");
+		double result = sotv(t,o,r, status);
+		if (!std::isfinite(result)) {
+			status |= NONFINITE;
+			return 0;
 		}
 		return result;
 	}
 
 private:
 
-	// parameters: triangle vertices, sphere center & radius
-	static double sotv(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r)
+	__attribute__((cold, noinline))
+	static void report([[maybe_unused]] const SOTVTriangle& t, [[maybe_unused]] vec3f o, [[maybe_unused]] double r, unsigned status) noexcept(!debug && !Trace::throws)
+	{
+		if (status & TANGENT) sotv_stats.tangent++;
+		if (status & NONFINITE) sotv_stats.nonfinite++;
+#ifdef SOTV_DEBUG
+		console.warn("SOTV degenerate case, status:", status);
+		console.warn("arg:",t.v1,t.v2,t.v3,o,r);
+		unsigned traced = OK;
+		SOTVKernel<SOTVTrace>::sotv(t,o,r, traced);
+		if (status & TANGENT)
+			throw "failed computing segment sphere intersection";
+		throw "1";
+#endif
+	}
+
+	// parameters: triangle, sphere center & radius, status bits to add to
+	static double sotv(const SOTVTriangle& t, vec3f o, double r, unsigned& status) noexcept(!Trace::throws)
 	{
+		const vec3f &v1 = t.v1, &v2 = t.v2, &v3 = t.v3;
 		bool out1 = (sqrlen(v1-o) > r*r);
 		bool out2 = (sqrlen(v2-o) > r*r);
 		bool out3 = (sqrlen(v3-o) > r*r);
 		int n_out = out1 + out2 + out3;
-		// console.log("n_vert_out:", n_out);
+		Trace::log("n_vert_out:", n_out);
 		if (n_out == 0) return sotv_case_a(v1, v2, v3, o,r);
-		if (n_out == 3) return sotv_case_b(v1, v2, v3, o,r);
+		if (n_out == 3) return sotv_case_b(t, o,r);
 		if (n_out == 2) {
-			if (!out1) return sotv_case_c(v1, v2,v3, o,r);
-			if (!out2) return sotv_case_c(v2, v1,v3, o,r);
-			if (!out3) return sotv_case_c(v3, v1,v2, o,r);
-		}
-		if (n_out == 1) {
-			if (out1) return sotv_case_d(v1, v2,v3, o,r);
-			if (out2) return sotv_case_d(v2, v1,v3, o,r);
-			if (out3) return sotv_case_d(v3, v1,v2, o,r);
+			if (!out1) return sotv_case_c(v1, v2,v3, o,r, t.l23, status);
+			if (!out2) return sotv_case_c(v2, v1,v3, o,r, t.l31, status);
+			if (!out3) return sotv_case_c(v3, v1,v2, o,r, t.l12, status);
 		}
-		assert(false);
+		if (out1) return sotv_case_d(v1, v2,v3, o,r, status);
+		if (out2) return sotv_case_d(v2, v1,v3, o,r, status);
+		return sotv_case_d(v3, v1,v2, o,r, status);
 	}
 
 	static double cot(double x)
@@ -60,6 +177,12 @@ private:
 
 	static double solid_angle_tetrahedron(vec3f oa, vec3f ob, vec3f oc)
 	{
+		if (fast_math) {
+			// Van Oosterom & Strackee, tan(omega/2) = |triple| / den
+			double la = norm(oa), lb = norm(ob), lc = norm(oc);
+			double den = la*lb*lc + dot(oa,ob)*lc + dot(oa,oc)*lb + dot(ob,oc)*la;
+			return 2 * fast_atan2(std::abs(dot(oa, cross(ob, oc))), den);
+		}
 		// https://math.stackexchange.com/a/3305625
 		double cosa = dot(ob,oc) / (norm(ob)*norm(oc));
 		double cosb = dot(oa,oc) / (norm(oa)*norm(oc));
@@ -84,8 +207,9 @@ private:
 		return std::abs(dot(oa, cross(ob, oc))) / 6;
 	}
 
-	// params: end points of line segment, center of sphere, radius
-	static vec3f line_sphere_intersection_1o(vec3f a, vec3f b, vec3f o, double r)
+	// params: end points of line segment, center of sphere, radius, status bits to add to
+	// near tangent segments are clamped to their nearest point, adding TANGENT to status
+	static vec3f line_sphere_intersection_1o(vec3f a, vec3f b, vec3f o, double r, unsigned& status)
 	{
 		// solve for non-negative d: ||a+d(b-a)-o||=r
 		// https://en.wikipedia.org/wiki/Line%E2%80%93sphere_intersection
@@ -94,24 +218,28 @@ private:
 		double B = 2 * dot(b-a, a-o);
 		double C = sqrlen(a-o) - r*r;
 		double delta = B*B - 4*A*C;
-		if (delta < -1e-5 * B*B)
-			throw "failed computing line sphere intersection";
+		if (delta < -1e-5 * B*B) {
+			status |= TANGENT;
+			Trace::fail("failed computing line sphere intersection");
+		}
 		delta = std::max(0.0, delta);
 		double d1 = (-B - std::sqrt(delta)) / (2*A);
 		double d2 = (-B + std::sqrt(delta)) / (2*A);
-		double d = (abs(d1-0.5) < abs(d2-0.5))? d1: d2;
-		if (d < -1e-5 || d > 1+1e-5)
-			throw "failed computing segment sphere intersection";
+		double d = (std::abs(d1-0.5) < std::abs(d2-0.5))? d1: d2;
+		if (d < -1e-5 || d > 1+1e-5) {
+			status |= TANGENT;
+			Trace::fail("failed computing segment sphere intersection");
+			d = std::max(0.0, std::min(1.0, d));
+		}
 		return a + d * (b-a);
 	}
 
-	// params: end points of line segment, center of sphere, radius
-	static bool line_sphere_intersection_2o(vec3f a, vec3f b, vec3f o, double r, vec3f& p1, vec3f& p2)
+	// params: end points of line segment, center of sphere, radius, squared length of segment
+	static bool line_sphere_intersection_2o(vec3f a, vec3f b, vec3f o, double r, double A, vec3f& p1, vec3f& p2)
 	{
 		// solve for d: ||a+d(b-a)-o||=r
 		// https://en.wikipedia.org/wiki/Line%E2%80%93sphere_intersection
 		// rearrange as quadratic equation
-		double A = sqrlen(b-a);
 		double B = 2 * dot(b-a, a-o);
 		double C = sqrlen(a-o) - r*r;
 		double delta = B*B - 4*A*C;
@@ -137,6 +265,8 @@ private:
 		oc -= (p1-p0) / sqrlen(p1-p0) * dot(oc, p1-p0);
 		c = o + oc;
 		double cosa = dot(c-p,o-p) / (norm(c-p) * norm(o-p));
+		if (fast_math)
+			return swing_volume_fast(std::min(1.0, std::max(-1.0, cosa)), norm(p - o), r);
 		double a = acos(std::min(1.0, std::max(-1.0, cosa)));
 		double r0 = norm(p - o);
 		double h = r - r0;
@@ -144,11 +274,32 @@ private:
 		auto sqr = [](double a){return a*a;};
 		auto cub = [](double a){return a*a*a;};
 		// final formula
+		Trace::log("  a,phi0,r0,R",a,phi0,r0,r);
 		if (phi0 >= a || std::abs(phi0)<1e-12) return 0;
 		double K1 = sqrt(sqr(sin(a)) - sqr(sin(phi0)));
 		double K2 = atan(cos(a) * sin(phi0) / K1);
+		Trace::log("  K1,K2",K1,K2);
 		double V = cub(r0*sin(a))/3 * (sqr(cot(phi0)) * (K2-PI/2) + K1*csc(phi0)*cot(a)*csc(a))
 			- 2.0/3*r*r*r0*sin(a) * (csc(phi0) * (asin(cos(a)/cos(phi0)) - PI/2) - K2 + PI/2);
+		Trace::log("swing v:",V);
+		return V;
+	}
+
+	// swing_volume() with sin & cos of its angles from identities,
+	// e.g. sin(acos(x)) = sqrt(1-x^2), so only 2 calls of polynomial inverse trigonometric functions remain
+	static double swing_volume_fast(double cosa, double r0, double r)
+	{
+		auto sqr = [](double a){return a*a;};
+		auto cub = [](double a){return a*a*a;};
+		double sina = std::sqrt((1-cosa) * (1+cosa));
+		double sinphi0 = r0 * sina / r;
+		// phi0 >= a  <=>  a <= PI/2 && r0 >= r, as phi0 is in [0, PI/2]
+		if ((cosa >= 0 && r0 >= r) || sinphi0 < 1e-12) return 0;
+		double cosphi0 = std::sqrt(std::max(0.0, (1-sinphi0) * (1+sinphi0)));
+		double K1 = std::sqrt(std::max(0.0, sqr(sina) - sqr(sinphi0)));
+		double K2 = fast_atan2(cosa * sinphi0, K1);
+		double V = cub(r0*sina)/3 * (sqr(cosphi0/sinphi0) * (K2-PI/2) + K1/sinphi0 * cosa/sqr(sina))
+			- 2.0/3*r*r*r0*sina * ((fast_asin(cosa/cosphi0) - PI/2) / sinphi0 - K2 + PI/2);
 		return V;
 	}
 
@@ -156,15 +307,18 @@ private:
 	static double sotv_case_a(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r)
 	{
 		double omega = solid_angle_tetrahedron(v1-o, v2-o, v3-o);
+		Trace::log("SR tetr:", omega);
 		double V = volume_tetrahedron(v1-o, v2-o, v3-o);
-		return r*r*r*omega/3 - V;
+		double result = r*r*r*omega/3 - V;
+		Trace::log("case a :", result);
+		return result;
 	}
 
-	// swing volume needed to subtract at an edge of triangle
-	static double slice_remaining(vec3f a, vec3f b, vec3f c, vec3f o, double r)
+	// swing volume needed to subtract at edge a-b of triangle, ab2: squared length of edge
+	static double slice_remaining(vec3f a, vec3f b, vec3f c, vec3f o, double r, double ab2)
 	{
 		vec3f p0, p1;
-		bool intersect = line_sphere_intersection_2o(a,b,o,r, p0,p1);
+		bool intersect = line_sphere_intersection_2o(a,b,o,r, ab2, p0,p1);
 		if (!intersect) return 0.0;
 		// only accept p0!=p1 in between a,b
 		if (dot(p0-a,p0-b) >= 0 || dot(p1-a,p1-b) >= 0 || p0==p1) return 0.0;
@@ -172,64 +326,70 @@ private:
 	};
 
 	// (b) 3 vert. out
-	static double sotv_case_b(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r)
+	static double sotv_case_b(const SOTVTriangle& t, vec3f o, double r)
 	{
-		if (triangle_outside_sphere(v1,v2,v3, o,r))
+		if (triangle_outside_sphere(t, o,r))
 			return 0.0;
 		// first solve for infinite triangle
-		double vol = sotv_case_b_original(v1, v2, v3, o,r);
+		double vol = sotv_case_b_original(t, o,r);
 		// then subtract swing volumes
-		vol -= slice_remaining(v2,v3, v1, o,r);
-		vol -= slice_remaining(v1,v3, v2, o,r);
-		vol -= slice_remaining(v1,v2, v3, o,r);
+		vol -= slice_remaining(t.v2,t.v3, t.v1, o,r, t.l23);
+		vol -= slice_remaining(t.v1,t.v3, t.v2, o,r, t.l31);
+		vol -= slice_remaining(t.v1,t.v2, t.v3, o,r, t.l12);
 		return vol;
 	}
 
 	// (b) 3 vert. out  (formula in original paper, which seems to assume infinite triangle)
-	static double sotv_case_b_original(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r)
+	static double sotv_case_b_original(const SOTVTriangle& t, vec3f o, double r)
 	{
 		// d: distance from center to triangle
-		double d = 6 * volume_tetrahedron(v1-o, v2-o, v3-o) / norm(cross(v2-v1, v3-v1));
+		double d = 6 * volume_tetrahedron(t.v1-o, t.v2-o, t.v3-o) / t.cross_norm;
 		if (d >= r) return 0;
 		double h = r - d;
 		// return volume of sphereical cap
 		return PI*h*h*(r-h/3);
 	}
 
-	// (c) 2 vert. out
-	static double sotv_case_c(vec3f vin, vec3f v2, vec3f v3, vec3f o, double r)
+	// (c) 2 vert. out, l23: squared length of v2-v3
+	static double sotv_case_c(vec3f vin, vec3f v2, vec3f v3, vec3f o, double r, double l23, unsigned& status)
 	{
 		// first solve for infinite triangle
-		double vol = sotv_case_c_original(vin, v2, v3, o,r);
+		double vol = sotv_case_c_original(vin, v2, v3, o,r, status);
 		// then subtract swing volumes
-		vol -= slice_remaining(v2,v3, vin, o,r);
+		vol -= slice_remaining(v2,v3, vin, o,r, l23);
+		Trace::log("case c :", vol);
 		return vol;
 	}
 
 	// (c) 2 vert. out  (formula in original paper, which seems to assume infinite triangle)
-	static double sotv_case_c_original(vec3f vin, vec3f v2, vec3f v3, vec3f o, double r)
+	static double sotv_case_c_original(vec3f vin, vec3f v2, vec3f v3, vec3f o, double r, unsigned& status)
 	{
-		vec3f p0 = line_sphere_intersection_1o(vin, v2, o,r);
-		vec3f p1 = line_sphere_intersection_1o(vin, v3, o,r);
-		return sotv_case_a(p0,p1,vin,o,r) + swing_volume(p0,p1,vin,o,r);
+		vec3f p0 = line_sphere_intersection_1o(vin, v2, o,r, status);
+		vec3f p1 = line_sphere_intersection_1o(vin, v3, o,r, status);
+		double result = sotv_case_a(p0,p1,vin,o,r) + swing_volume(p0,p1,vin,o,r);
+		Trace::log("case co:", result);
+		return result;
 	}
 
 	// (d) 1 vert. out
-	static double sotv_case_d(vec3f vout, vec3f v2, vec3f v3, vec3f o, double r)
+	static double sotv_case_d(vec3f vout, vec3f v2, vec3f v3, vec3f o, double r, unsigned& status)
 	{
-		vec3f p0 = line_sphere_intersection_1o(vout, v2, o,r);
-		return sotv_case_c(v3, vout,p0, o,r) + sotv_case_a(v3,v2,p0, o,r);
+		vec3f p0 = line_sphere_intersection_1o(vout, v2, o,r, status);
+		double result = sotv_case_c(v3, vout,p0, o,r, sqrlen(p0-vout), status) + sotv_case_a(v3,v2,p0, o,r);
+		Trace::log("case d :", result);
+		return result;
 	}
 
-	static bool triangle_outside_sphere(vec3f a, vec3f b, vec3f c, vec3f o, double r)
+	static bool triangle_outside_sphere(const SOTVTriangle& t, vec3f o, double r)
 	{
+		const vec3f &a = t.v1, &b = t.v2, &c = t.v3;
 		// case 1. nearest point to sphere on triangle is inside triangle
 		// first draw line perpendicular to triangle
-		vec3f p = normalized(cross(a-b, a-c));
+		const vec3f& p = t.unit_normal;
 		// which passes through o and intersects plane of triangle at d
 		vec3f d = o + p * dot(a-o, p);
 		// then we check if d is inside the triangle
-		vec3f facedir_ref = cross(b-a, c-b); // abc
+		const vec3f& facedir_ref = t.facedir; // abc
 		double sgn1 = dot(facedir_ref, cross(a-d, b-a)); // dab
 		double sgn2 = dot(facedir_ref, cross(b-d, c-b)); // dbc
 		double sgn3 = dot(facedir_ref, cross(c-d, a-c)); // dca
@@ -240,18 +400,18 @@ private:
 			return h>=r;
 		}
 		// case 2. nearest point to sphere on triangle is on an edge
-		auto touch_edge = [](vec3f a, vec3f b, vec3f o, double r)
+		auto touch_edge = [](vec3f a, vec3f b, double ab2, vec3f o, double r)
 		{
 			vec3f oa = a-o;
-			vec3f op = oa - dot(oa, a-b) * (a-b) / sqrlen(a-b);
+			vec3f op = oa - dot(oa, a-b) * (a-b) / ab2;
 			vec3f p = o + op;
 			if (dot(p-a, p-b)<=0)
 				return norm(op)<r;
 			return false;
 		};
-		if (touch_edge(a,b,o,r)) return false;
-		if (touch_edge(b,c,o,r)) return false;
-		if (touch_edge(c,a,o,r)) return false;
+		if (touch_edge(a,b,t.l12,o,r)) return false;
+		if (touch_edge(b,c,t.l23,o,r)) return false;
+		if (touch_edge(c,a,t.l31,o,r)) return false;
 		// case 3. nearest point to sphere on triangle is among vertices
 		if (sqrlen(a-o) < r*r) return false;
 		if (sqrlen(b-o) < r*r) return false;
@@ -260,4 +420,23 @@ private:
 	}
 };
 
+typedef SOTVKernel<SOTVQuiet> SOTV;
+SOTV sotv;
+
+namespace debug {
+
+// SOTV logging its intermediate results, throwing on degenerate cases
+typedef SOTVKernel<SOTVTrace> SOTV;
 SOTV sotv;
+
+}
+
+// center on plane of a triangle, whose SOTV is then left out of SOV
+__attribute__((cold, noinline))
+void sotv_zero_sign()
+{
+	sotv_stats.zero_sign++;
+#ifdef SOTV_DEBUG
+	console.warn("sov: accumulating zero sign");
+#endif
+}
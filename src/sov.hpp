@@ -2,12 +2,63 @@
 
 #pragma once
 
+#include <algorithm>
+#include <functional>
 #include "math/vecmath.hpp"
 #include "rtcore/mesh.hpp"
 #include "rtcore/triangle.hpp"
-#include "point_in_mesh.hpp"
 #include "sotv.hpp"
+#include "sotv_simd.hpp"
 #include "sphere.hpp"
+#include "threadpool.hpp"
+#include "util.hpp"
+
+// parameters: whether center is in mesh, sphere radius, sum of signed SOTV over the mesh
+// adds the volume of the sphere not covered by the cones of triangles
+double sov_from_sotv(bool inside, double r, double s)
+{
+	if (!inside) {
+		if (s > 1e-6) console.warn("sov: ERR SIGN positive", s);
+		s += 4.0/3*PI * r*r*r;
+	}
+	else {
+		// fix edge case of a center misclassified as inside, rounding errors aside
+		if (s < -1e-6) {
+			console.warn("sov: ERR SIGN negative", s);
+			s += 4.0/3*PI * r*r*r;
+		}
+	}
+	return std::max(0.0, s);
+}
+
+// winding numbers nearer to 1/2 than this are computed again without far field approximation
+const double winding_margin = 0.25;
+
+// center o is inside if signed solid angle of mesh seen from it is ~4pi (winding number 1)
+// solid_angle may approximate distant subtrees of BVH, if it isn't clearly decided the exact sum is
+bool inside_by_solid_angle(const RTcore::Mesh& mesh, vec3f o, double solid_angle)
+{
+	double w = solid_angle / (4*PI);
+	if (std::abs(w - 0.5) < winding_margin)
+		w = mesh.winding_number(o, true);
+	return w > 0.5;
+}
+
+// SOV without evaluating any triangle, in O(log n), when the sphere contains the whole mesh
+// or its surface doesn't reach the sphere. returns whether one of these cases applies
+bool sov_early_out(const RTcore::Mesh& mesh, vec3f o, double r, double& result)
+{
+	double sphere = 4.0/3*PI * r*r*r;
+	if (mesh.boundingVolume().inside(o, r)) {
+		result = std::max(0.0, sphere - mesh.volume());
+		return true;
+	}
+	if (mesh.distance(o, r) >= r) {
+		result = inside_by_solid_angle(mesh, o, 4*PI * mesh.winding_number(o))? 0: sphere;
+		return true;
+	}
+	return false;
+}
 
 // parameters: mesh, sphere center & radius
 double sov(const RTcore::Mesh& mesh, vec3f o, double r)
@@ -16,26 +67,151 @@ double sov(const RTcore::Mesh& mesh, vec3f o, double r)
 	auto sgn = [](double x){
 		if (x>0) return 1;
 		if (x<0) return -1;
-		console.warn("sov: accumulating zero sign");
+		sotv_zero_sign();
 		return 0;
 	};
-	for (auto t : mesh.list)
+	// triangles not touching the sphere have zero SOTV,
+	// they only add to the solid angle which tells whether center is inside
+	double omega = 0;
+	for (int i : mesh.intersect_sphere(o,r, &omega)) {
+		auto t = mesh.list[i];
 		s += sotv(t->v1, t->v2, t->v3, o,r) * sgn(dot(t->v1-o, t->planeNormal));
-	if (!point_in_mesh(o, mesh)) {
-		if (s > 1e-6) console.warn("sov: ERR SIGN positive", s);
-		s += 4.0/3*PI * r*r*r;
+		omega += t->solidAngle(o);
+	}
+	return sov_from_sotv(inside_by_solid_angle(mesh, o, omega), r, s);
+}
+
+double sov(const RTcore::Mesh& mesh, const Sphere& sphere)
+{
+	return sov(mesh, sphere.center, sphere.radius);
+}
+
+// triangles per unit of parallel work; fewer than 4 units are evaluated serially
+const int sov_chunk = 512;
+
+// calls f(k, begin, end) on the k-th chunk [begin, end) of n triangles, in parallel for long lists
+// chunks don't depend on number of threads, so neither do sums of per-chunk results
+void sov_parallel_chunks(int n, std::function<void(int,int,int)> f)
+{
+	int n_chunk = (n + sov_chunk - 1) / sov_chunk;
+	auto job = [&](int k){ f(k, k*sov_chunk, std::min(n, (k+1)*sov_chunk)); };
+	if (n_chunk < 4) {
+		for (int k=0; k<n_chunk; ++k)
+			job(k);
 	}
 	else {
-		// silently fix edge case which point_in_mesh fails to handle
-		if (s < -1e-6) console.warn("sov: ERR SIGN negative", s);
-		if (s<0) {
-			s += 4.0/3*PI * r*r*r;
+		threadpool.run(n_chunk, job);
+	}
+}
+
+// sum of signed SOTV of triangles idx, adds their signed solid angle to omega
+// bit-identical for any number of threads
+double sotv_sum(const TriangleSoA& soa, const std::vector<int>& idx, vec3f o, double r, double& omega)
+{
+	int n_chunk = (idx.size() + sov_chunk - 1) / sov_chunk;
+	std::vector<double> s(n_chunk, 0), w(n_chunk, 0);
+	sov_parallel_chunks(idx.size(), [&](int k, int begin, int end){
+		s[k] = sotv_batch(soa, idx.data() + begin, end - begin, o,r, &w[k]);
+	});
+	omega += pairwise_sum(w);
+	return pairwise_sum(s);
+}
+
+// upper bound of |SOTV| of triangle t, without transcendental functions
+// SOTV is the part of the sphere inside the cone of t beyond t, so it lies within
+// distance d..r of o, d being the distance to t. Its solid angle is at most that of t,
+// the integral of h/rho^3 over t, h being the distance to the plane of t, so at most area*h/d^3.
+double sotv_bound(const RTcore::Triangle& t, vec3f o, double r)
+{
+	double d = norm(t.nearestPoint(o) - o);
+	if (d >= r) return 0;
+	double h = std::abs(dot(t.v1 - o, t.planeNormal));
+	double omega = (d > 0)? std::min(2*PI, t.surfaceArea() * h / (d*d*d)): 2*PI;
+	return omega * (r*r*r - d*d*d) / 3;
+}
+
+// removes from idx triangles whose bounds of |SOTV| sum to at most abs_tol, adding their solid angle to omega
+void skip_negligible(const RTcore::Mesh& mesh, const TriangleSoA& soa, std::vector<int>& idx, vec3f o, double r, double abs_tol, double& omega)
+{
+	double budget = abs_tol;
+	int n = 0;
+	auto sqr = [](double x){return x*x;};
+	for (int i: idx) {
+		// triangles inside the sphere are seldom negligible, not worth bounding
+		if (sqr(soa.x1[i]-o.x) + sqr(soa.y1[i]-o.y) + sqr(soa.z1[i]-o.z) <= r*r &&
+		    sqr(soa.x2[i]-o.x) + sqr(soa.y2[i]-o.y) + sqr(soa.z2[i]-o.z) <= r*r &&
+		    sqr(soa.x3[i]-o.x) + sqr(soa.y3[i]-o.y) + sqr(soa.z3[i]-o.z) <= r*r) {
+			idx[n++] = i;
+			continue;
+		}
+		const RTcore::Triangle* t = mesh.list[i];
+		double bound = sotv_bound(*t, o, r);
+		if (bound <= budget) {
+			budget -= bound;
+			omega += t->solidAngle(o);
+		}
+		else {
+			idx[n++] = i;
 		}
 	}
-	return s;
+	idx.resize(n);
 }
 
-double sov(const RTcore::Mesh& mesh, const Sphere& sphere)
+// parameters: mesh, SoA copy of its triangles, sphere center & radius,
+//   absolute tolerance: if positive, triangles whose SOTV provably sums to at most this are skipped
+// vectorized & multithreaded version of sov(), agreeing within the tolerance of sotv_batch() (plus abs_tol)
+// subtrees of BVH inside sphere are all case (a), their SOTV is summed per node instead of per triangle
+double sov(const RTcore::Mesh& mesh, const TriangleSoA& soa, vec3f o, double r, double abs_tol = 0)
 {
-	return sov(mesh, sphere.center, sphere.radius);
+	double early;
+	if (sov_early_out(mesh, o, r, early))
+		return early;
+	double omega = 0;
+	RTcore::Mesh::InnerSum inner;
+	std::vector<int> idx = mesh.intersect_sphere(o,r, &omega, inner);
+	if (abs_tol > 0)
+		skip_negligible(mesh, soa, idx, o,r, abs_tol, omega);
+	double s = sotv_sum(soa, idx, o,r, omega);
+	s += r*r*r * inner.solid_angle / 3 - inner.volume;
+	omega += inner.solid_angle;
+	return sov_from_sotv(inside_by_solid_angle(mesh, o, omega), r, s);
+}
+
+// SOV of many spheres, sharing one traversal of BVH & evaluated in parallel
+// bit-identical to sov() of each sphere
+std::vector<double> sov(const RTcore::Mesh& mesh, const TriangleSoA& soa, const std::vector<Sphere>& spheres, double abs_tol = 0)
+{
+	std::vector<double> result(spheres.size());
+	std::vector<char> early(spheres.size());
+	threadpool.run(spheres.size(), [&](int k){
+		early[k] = sov_early_out(mesh, spheres[k].center, spheres[k].radius, result[k]);
+	});
+	// the others share the traversal
+	std::vector<vec3f> o;
+	std::vector<double> r;
+	std::vector<int> which;
+	for (int k=0; k<spheres.size(); ++k)
+		if (!early[k]) {
+			o.push_back(spheres[k].center);
+			r.push_back(spheres[k].radius);
+			which.push_back(k);
+		}
+	const int n = which.size();
+	std::vector<double> omega(n, 0);
+	std::vector<RTcore::Mesh::InnerSum> inner(n);
+	std::vector<std::vector<int>> idx = mesh.intersect_spheres(o,r, omega, inner);
+	threadpool.run(n, [&](int k){
+		if (abs_tol > 0)
+			skip_negligible(mesh, soa, idx[k], o[k],r[k], abs_tol, omega[k]);
+		double s = sotv_sum(soa, idx[k], o[k],r[k], omega[k]);
+		s += r[k]*r[k]*r[k] * inner[k].solid_angle / 3 - inner[k].volume;
+		omega[k] += inner[k].solid_angle;
+		result[which[k]] = sov_from_sotv(inside_by_solid_angle(mesh, o[k], omega[k]), r[k], s);
+	});
+	return result;
+}
+
+double sov(const RTcore::Mesh& mesh, const TriangleSoA& soa, const Sphere& sphere, double abs_tol = 0)
+{
+	return sov(mesh, soa, sphere.center, sphere.radius, abs_tol);
 }
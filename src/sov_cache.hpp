@@ -0,0 +1,98 @@
+// memoization of a loss function of spheres
+// keyed on exact bits of center & radius, bounded in memory with LRU eviction
+
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include "sphere.hpp"
+
+class SOVCache
+{
+	struct Key {
+		uint64_t bits[4];
+		Key(const Sphere& s)
+		{
+			double v[4] = {s.center.x, s.center.y, s.center.z, s.radius};
+			std::memcpy(bits, v, sizeof bits);
+		}
+		bool operator== (const Key& k) const
+		{
+			return std::memcmp(bits, k.bits, sizeof bits) == 0;
+		}
+	};
+	struct KeyHash {
+		size_t operator() (const Key& k) const
+		{
+			uint64_t h = 0;
+			for (uint64_t b: k.bits)
+				h = (h ^ b) * 0x100000001b3ull;
+			return h ^ (h >> 29);
+		}
+	};
+	typedef std::list<std::pair<Key, double>> LRUList;
+	// rough memory taken by one entry: list node, hash node & bucket
+	static const size_t entry_bytes = sizeof(LRUList::value_type) + 2*sizeof(void*)
+		+ sizeof(Key) + sizeof(LRUList::iterator) + 2*sizeof(void*);
+
+	std::function<double(Sphere)> f;
+	size_t capacity;
+	LRUList lru; // most recently used at front
+	std::unordered_map<Key, LRUList::iterator, KeyHash> table;
+	std::atomic<long long> n_hit{0}, n_miss{0}; // read without lock
+	std::mutex mtx;
+
+public:
+	// parameters: function to memoize, memory cap in bytes (0 disables caching)
+	SOVCache(std::function<double(Sphere)> f, size_t max_bytes):
+		f(f), capacity(max_bytes / entry_bytes) {}
+
+	double operator()(const Sphere& s)
+	{
+		double value;
+		if (find(s, value))
+			return value;
+		// evaluate outside of lock so that other threads aren't blocked
+		value = f(s);
+		insert(s, value);
+		return value;
+	}
+
+	// looks up cached value of s, counting a hit or miss
+	bool find(const Sphere& s, double& value)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = table.find(Key(s));
+		if (it == table.end()) {
+			n_miss++;
+			return false;
+		}
+		n_hit++;
+		lru.splice(lru.begin(), lru, it->second);
+		value = it->second->second;
+		return true;
+	}
+
+	void insert(const Sphere& s, double value)
+	{
+		Key key(s);
+		std::lock_guard<std::mutex> lock(mtx);
+		if (capacity == 0 || table.count(key))
+			return;
+		lru.push_front({key, value});
+		table[key] = lru.begin();
+		if (lru.size() > capacity) {
+			table.erase(lru.back().first);
+			lru.pop_back();
+		}
+	}
+
+	long long hits() const { return n_hit; }
+	long long misses() const { return n_miss; }
+	size_t size() const { return lru.size(); }
+};
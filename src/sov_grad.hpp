@@ -0,0 +1,99 @@
+// gradient of Sphere Outside Volume (SOV) w.r.t. sphere center & radius
+//
+// By divergence theorem over the part of the sphere outside the mesh,
+//   d SOV / d o = sum over triangles of  n * A
+//   d SOV / d r = (3 SOV + sum over triangles of  h * A) / r
+// where n is outward unit normal of triangle, h = dot(v1-o, n) its signed
+// distance to the center and A the area of the triangle inside the sphere.
+
+#pragma once
+
+#include <cmath>
+#include "math/vecmath.hpp"
+#include "rtcore/mesh.hpp"
+#include "sotv_simd.hpp"
+#include "sov.hpp"
+
+// area of triangle (c,a,b) inside disk of radius R centered at c, signed by normal n
+// a,b are relative to c and lie in the plane of the disk
+double sector_triangle_area_in_disk(vec3f a, vec3f b, vec3f n, double R)
+{
+	auto sector = [&](vec3f u, vec3f v) {
+		return R*R/2 * std::atan2(dot(cross(u,v), n), dot(u,v));
+	};
+	if (sqrlen(a) <= R*R && sqrlen(b) <= R*R)
+		return dot(cross(a,b), n) / 2;
+	// solve |a + t(b-a)| = R
+	vec3f d = b-a;
+	double A = sqrlen(d);
+	double B = 2 * dot(a, d);
+	double C = sqrlen(a) - R*R;
+	double delta = B*B - 4*A*C;
+	if (delta <= 0)
+		return sector(a,b);
+	double t1 = (-B - std::sqrt(delta)) / (2*A);
+	double t2 = (-B + std::sqrt(delta)) / (2*A);
+	if (t2 <= 0 || t1 >= 1)
+		return sector(a,b);
+	vec3f p1 = a + std::max(0.0, t1) * d;
+	vec3f p2 = a + std::min(1.0, t2) * d;
+	return sector(a,p1) + dot(cross(p1,p2), n) / 2 + sector(p2,b);
+}
+
+// area of triangle v1-v2-v3 inside sphere
+double triangle_area_in_sphere(vec3f v1, vec3f v2, vec3f v3, vec3f o, double r)
+{
+	vec3f n = normalized(cross(v2-v1, v3-v1));
+	double h = dot(v1-o, n);
+	if (h*h >= r*r)
+		return 0;
+	// sphere cuts the plane in a disk
+	vec3f c = o + h * n;
+	double R = std::sqrt(r*r - h*h);
+	double area = sector_triangle_area_in_disk(v1-c, v2-c, n, R)
+	            + sector_triangle_area_in_disk(v2-c, v3-c, n, R)
+	            + sector_triangle_area_in_disk(v3-c, v1-c, n, R);
+	return std::max(0.0, area);
+}
+
+// parameters: mesh, SoA copy of its triangles, sphere center & radius, absolute tolerance as in sov()
+// returns SOV, bit-identical to sov() of the same tolerance, writes its partial derivatives to grad_o & grad_r
+// (triangles skipped as negligible are left out of the gradient too)
+double sov(const RTcore::Mesh& mesh, const TriangleSoA& soa, vec3f o, double r, vec3f& grad_o, double& grad_r, double abs_tol = 0)
+{
+	double early;
+	if (sov_early_out(mesh, o, r, early)) {
+		// SOV is 0 or grows with the volume of the sphere
+		grad_o = vec3f(0);
+		grad_r = (early > 0)? 4*PI * r*r: 0;
+		return early;
+	}
+	double omega = 0;
+	RTcore::Mesh::InnerSum inner;
+	std::vector<int> idx = mesh.intersect_sphere(o,r, &omega, inner);
+	if (abs_tol > 0)
+		skip_negligible(mesh, soa, idx, o,r, abs_tol, omega);
+	double s = sotv_sum(soa, idx, o,r, omega);
+	s += r*r*r * inner.solid_angle / 3 - inner.volume;
+	omega += inner.solid_angle;
+	double result = sov_from_sotv(inside_by_solid_angle(mesh, o, omega), r, s);
+	int n_chunk = (idx.size() + sov_chunk - 1) / sov_chunk;
+	std::vector<vec3f> nA(n_chunk, vec3f(0));
+	std::vector<double> hA(n_chunk, 0);
+	sov_parallel_chunks(idx.size(), [&](int k, int begin, int end){
+		for (int j=begin; j<end; ++j) {
+			int i = idx[j];
+			vec3f v1(soa.x1[i], soa.y1[i], soa.z1[i]);
+			vec3f v2(soa.x2[i], soa.y2[i], soa.z2[i]);
+			vec3f v3(soa.x3[i], soa.y3[i], soa.z3[i]);
+			vec3f n(soa.nx[i], soa.ny[i], soa.nz[i]);
+			double A = triangle_area_in_sphere(v1,v2,v3, o,r);
+			nA[k] += A * n;
+			hA[k] += dot(v1-o, n) * A;
+		}
+	});
+	// triangles of inner subtrees are wholly in sphere, with sum of h * A = 3 * volume of cones
+	grad_o = pairwise_sum(nA) + inner.area_normal;
+	grad_r = (r > 0)? (3*result + pairwise_sum(hA) + 3*inner.volume) / r: 0;
+	return result;
+}
@@ -0,0 +1,89 @@
+// piecewise quadratic model of Sphere Outside Volume (SOV) as a function of radius, for a fixed center
+//
+// Built by adaptive bisection from exact samples: an interval is accepted once the quadratic
+// through its ends & midpoint predicts the samples at its quarter points within tol times
+// the sphere volume, then it's split into 2 pieces using those samples.
+// The error band is an estimate from these checks, not a strict bound.
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include "math/vecmath.hpp"
+
+class SOVSpline
+{
+	// pieces are quadratics through (r[2k], f[2k]), (r[2k+1], f[2k+1]), (r[2k+2], f[2k+2])
+	std::vector<double> r, f;
+	double tol;
+	int n_sample = 0;
+	static const int initial_pieces = 4;
+	static const int max_depth = 10;
+
+	static double quadratic(double x0, double y0, double x1, double y1, double x2, double y2, double x)
+	{
+		return y0 * (x-x1)*(x-x2) / ((x0-x1)*(x0-x2))
+		     + y1 * (x-x0)*(x-x2) / ((x1-x0)*(x1-x2))
+		     + y2 * (x-x0)*(x-x1) / ((x2-x0)*(x2-x1));
+	}
+
+public:
+	// parameters: exact SOV of radius, largest radius queried, tolerance relative to sphere volume
+	SOVSpline(std::function<double(double)> sov, double rmax, double tol): tol(tol)
+	{
+		std::function<double(double)> eval = [&](double x) {
+			n_sample++;
+			return sov(x);
+		};
+		r.push_back(0);
+		f.push_back(eval(0));
+		if (rmax <= 0) return;
+		for (int i=0; i<initial_pieces; ++i) {
+			double a = rmax * i / initial_pieces;
+			double b = rmax * (i+1) / initial_pieces;
+			double m = (a+b) / 2;
+			refine(eval, a, f.back(), m, eval(m), b, eval(b), 0);
+		}
+	}
+
+	// estimated SOV of radius x, for 0 <= x <= rmax
+	double operator()(double x) const
+	{
+		if (r.size() == 1) return f[0];
+		int k = std::upper_bound(r.begin(), r.end(), x) - r.begin() - 1;
+		k = std::max(0, std::min(k, (int)r.size()-2));
+		k -= k % 2;
+		return quadratic(r[k], f[k], r[k+1], f[k+1], r[k+2], f[k+2], x);
+	}
+
+	// width of error band at radius x
+	double error(double x) const
+	{
+		return tol * 4.0/3*PI*x*x*x;
+	}
+
+	// number of exact evaluations taken
+	int samples() const
+	{
+		return n_sample;
+	}
+
+private:
+	// appends pieces covering (a, b], given samples at a, its midpoint m & b
+	void refine(const std::function<double(double)>& eval, double a, double fa, double m, double fm, double b, double fb, int depth)
+	{
+		double q1 = (a+m) / 2, q3 = (m+b) / 2;
+		double f1 = eval(q1), f3 = eval(q3);
+		double err = std::max(std::abs(quadratic(a,fa, m,fm, b,fb, q1) - f1),
+		                      std::abs(quadratic(a,fa, m,fm, b,fb, q3) - f3));
+		if (err <= error(q1) || depth >= max_depth) {
+			r.insert(r.end(), {q1, m, q3, b});
+			f.insert(f.end(), {f1, fm, f3, fb});
+			return;
+		}
+		refine(eval, a, fa, q1, f1, m, fm, depth+1);
+		refine(eval, m, fm, q3, f3, b, fb, depth+1);
+	}
+};
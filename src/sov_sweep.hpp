@@ -0,0 +1,123 @@
+// calculate Sphere Outside Volume (SOV) of concentric spheres of growing radius
+//
+// For a fixed center, the SOTV of a triangle is
+//   0                   while r <= distance to nearest point of triangle
+//   r^3 * omega/3 - V   once r >= distance to farthest vertex (case a)
+// and only needs evaluating in between. Triangles are kept in three groups:
+// pending (not reached yet), active (crossing the sphere) and absorbed
+// (inside the sphere, summed into two coefficients), so each query only
+// evaluates SOTV on active triangles.
+// Triangles are absorbed in order of farthest vertex distance and active ones
+// are summed in index order, so the result for a radius doesn't depend on the
+// radii queried before.
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "math/vecmath.hpp"
+#include "rtcore/mesh.hpp"
+#include "sotv_simd.hpp"
+#include "sov.hpp"
+
+class SOVSweep
+{
+	const RTcore::Mesh& mesh;
+	const TriangleSoA& soa;
+	vec3f o;
+	bool inside;
+	double lastr = 0;
+	// triangles with bounding box in ball of radius fetchr have been fetched
+	double fetchr = 0;
+	std::vector<int> fetched; // ascending
+	// sorted by distance to nearest point, descending (consumed from back)
+	std::vector<std::pair<double,int>> pending;
+	// min-heap of (squared distance to farthest vertex, triangle)
+	std::vector<std::pair<double,int>> active;
+	// indices of active triangles, ascending
+	std::vector<int> batch;
+	// sum of signed solid angle & signed volume of absorbed triangles
+	double omega_sum = 0;
+	double vol_sum = 0;
+
+public:
+	// parameters: mesh, SoA copy of its triangles, sphere center
+	SOVSweep(const RTcore::Mesh& mesh, const TriangleSoA& soa, vec3f o):
+		mesh(mesh), soa(soa), o(o), inside(inside_by_solid_angle(mesh, o, 4*PI * mesh.winding_number(o))) {}
+
+	// SOV of sphere of radius r
+	// cheapest when called with non-decreasing r
+	double operator()(double r)
+	{
+		if (r < lastr)
+			reset();
+		lastr = r;
+		if (r > fetchr)
+			fetch(std::max(r, 2*fetchr));
+		// pending triangles reached by sphere become active
+		while (!pending.empty() && pending.back().first <= r) {
+			int i = pending.back().second;
+			pending.pop_back();
+			active.push_back({std::max({sqrlen(vertex1(i)-o), sqrlen(vertex2(i)-o), sqrlen(vertex3(i)-o)}), i});
+			std::push_heap(active.begin(), active.end(), std::greater<std::pair<double,int>>());
+		}
+		// active triangles with all vertices inside sphere are absorbed
+		while (!active.empty() && active.front().first <= r*r) {
+			absorb(active.front().second);
+			std::pop_heap(active.begin(), active.end(), std::greater<std::pair<double,int>>());
+			active.pop_back();
+		}
+		batch.clear();
+		for (auto& a: active)
+			batch.push_back(a.second);
+		std::sort(batch.begin(), batch.end());
+		double s = r*r*r * omega_sum / 3 - vol_sum;
+		s += sotv_batch(soa, batch.data(), batch.size(), o,r);
+		return sov_from_sotv(inside, r, s);
+	}
+
+	// bytes held, growing with the triangles reached by the sphere
+	size_t bytes() const
+	{
+		return fetched.capacity() * sizeof(int) + pending.capacity() * sizeof(std::pair<double,int>)
+			+ active.capacity() * sizeof(std::pair<double,int>) + batch.capacity() * sizeof(int);
+	}
+
+private:
+	vec3f vertex1(int i) const { return vec3f(soa.x1[i], soa.y1[i], soa.z1[i]); }
+	vec3f vertex2(int i) const { return vec3f(soa.x2[i], soa.y2[i], soa.z2[i]); }
+	vec3f vertex3(int i) const { return vec3f(soa.x3[i], soa.y3[i], soa.z3[i]); }
+
+	void reset()
+	{
+		fetchr = 0;
+		fetched.clear();
+		pending.clear();
+		active.clear();
+		omega_sum = 0;
+		vol_sum = 0;
+	}
+
+	void fetch(double radius)
+	{
+		std::vector<int> all = mesh.intersect_sphere(o, radius);
+		std::vector<int> added;
+		std::set_difference(all.begin(), all.end(), fetched.begin(), fetched.end(), std::back_inserter(added));
+		for (int i: added)
+			pending.push_back({norm(mesh.list[i]->nearestPoint(o) - o), i});
+		std::sort(pending.begin(), pending.end(), std::greater<std::pair<double,int>>());
+		fetched = std::move(all);
+		fetchr = radius;
+	}
+
+	void absorb(int i)
+	{
+		vec3f a = vertex1(i)-o, b = vertex2(i)-o, c = vertex3(i)-o;
+		double side = dot(a, vec3f(soa.nx[i], soa.ny[i], soa.nz[i]));
+		int sgn = (side > 0) - (side < 0);
+		if (sgn == 0)
+			sotv_zero_sign();
+		omega_sum += sgn * RTcore::solid_angle(a,b,c);
+		vol_sum += sgn * std::abs(dot(a, cross(b,c))) / 6;
+	}
+};
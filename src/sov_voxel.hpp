@@ -0,0 +1,110 @@
+// approximate Sphere Outside Volume (SOV) by counting voxels
+//
+// The manifold is rasterized once into a bit-packed inside/outside grid: each row along x is
+// filled by the parity of ray hits, 64 voxels per word. A sphere covers a span of voxels in each
+// row, its outside volume is the number of covered voxels minus the inside ones, counted by
+// popcount over the span's words. Rows beyond the grid are all outside.
+// Loss is piecewise constant in the sphere, only meant for coarse early iterations.
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include "math/vecmath.hpp"
+#include "rtcore/mesh.hpp"
+#include "rtcore/ray.hpp"
+#include "sphere.hpp"
+
+class SOVGrid
+{
+	vec3f lo;    // corner of voxel (0,0,0)
+	double h;    // voxel edge length
+	int nx, ny, nz;
+	int words;   // words per row
+	std::vector<uint64_t> bits; // row (j,k) starts at (k*ny + j) * words
+
+public:
+	// parameters: closed mesh, number of voxels along longest side of its bounding box
+	SOVGrid(const RTcore::Mesh& mesh, int resolution)
+	{
+		RTcore::AABox box = mesh.boundingVolume();
+		vec3f size(box.x2 - box.x1, box.y2 - box.y1, box.z2 - box.z1);
+		h = std::max({size.x, size.y, size.z}) / resolution;
+		nx = std::max(1, (int)std::ceil(size.x / h));
+		ny = std::max(1, (int)std::ceil(size.y / h));
+		nz = std::max(1, (int)std::ceil(size.z / h));
+		lo = vec3f(box.x1, box.y1, box.z1);
+		words = (nx + 63) / 64;
+		bits.assign((size_t)words * ny * nz, 0);
+		// rows are shifted off voxel centers by a tiny irrational amount,
+		// so they don't run along edges of axis-aligned meshes
+		const double jitter = 1e-4 * (std::sqrt(5.0) - 1);
+		for (int k=0; k<nz; ++k)
+			for (int j=0; j<ny; ++j) {
+				vec3f start(lo.x - h, lo.y + (j+0.5+jitter) * h, lo.z + (k+0.5+jitter) * h);
+				// negative zeros put y & z in the branch of AABox::intersect() where division by them is right
+				RTcore::Ray ray(start, vec3f(1,-0.0,-0.0));
+				std::vector<double> hits;
+				for (auto t: mesh.intersect_all(ray)) {
+					double d;
+					if (t->intersect(ray, d))
+						hits.push_back(d);
+				}
+				std::sort(hits.begin(), hits.end());
+				// a hit on an edge shared by two triangles is one crossing
+				hits.erase(std::unique(hits.begin(), hits.end(), [&](double a, double b){return b - a < 1e-9 * h;}), hits.end());
+				uint64_t* row = &bits[((size_t)k * ny + j) * words];
+				for (int i=0; i+1 < hits.size(); i += 2) {
+					// voxels whose centers lie between an entering & a leaving hit
+					int i0 = std::max(0, (int)std::ceil((hits[i] - h) / h - 0.5));
+					int i1 = std::min(nx-1, (int)std::floor((hits[i+1] - h) / h - 0.5));
+					for (int x=i0; x<=i1; ++x)
+						row[x >> 6] |= 1ull << (x & 63);
+				}
+			}
+	}
+
+	// approximate SOV of s
+	double operator()(const Sphere& s) const
+	{
+		vec3f c = (s.center - lo) / h - vec3f(0.5); // center in voxel index units
+		double r = s.radius / h;
+		long long covered = 0, inside = 0;
+		int k0 = (int)std::ceil(c.z - r), k1 = (int)std::floor(c.z + r);
+		for (int k=k0; k<=k1; ++k) {
+			double rz2 = r*r - (k - c.z) * (k - c.z);
+			if (rz2 < 0) continue;
+			double rz = std::sqrt(rz2);
+			int j0 = (int)std::ceil(c.y - rz), j1 = (int)std::floor(c.y + rz);
+			for (int j=j0; j<=j1; ++j) {
+				double ry2 = rz2 - (j - c.y) * (j - c.y);
+				if (ry2 < 0) continue;
+				double w = std::sqrt(ry2);
+				long long i0 = (long long)std::ceil(c.x - w), i1 = (long long)std::floor(c.x + w);
+				if (i1 < i0) continue;
+				covered += i1 - i0 + 1;
+				if (k < 0 || k >= nz || j < 0 || j >= ny) continue;
+				inside += count(&bits[((size_t)k * ny + j) * words], std::max(0LL, i0), std::min((long long)nx-1, i1));
+			}
+		}
+		return (covered - inside) * h*h*h;
+	}
+
+private:
+	// number of set bits of row in [i0, i1]
+	static long long count(const uint64_t* row, long long i0, long long i1)
+	{
+		if (i1 < i0) return 0;
+		int w0 = i0 >> 6, w1 = i1 >> 6;
+		uint64_t m0 = ~0ull << (i0 & 63);
+		uint64_t m1 = ~0ull >> (63 - (i1 & 63));
+		if (w0 == w1)
+			return __builtin_popcountll(row[w0] & m0 & m1);
+		long long n = __builtin_popcountll(row[w0] & m0) + __builtin_popcountll(row[w1] & m1);
+		for (int w=w0+1; w<w1; ++w)
+			n += __builtin_popcountll(row[w]);
+		return n;
+	}
+};
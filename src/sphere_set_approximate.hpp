@@ -1,13 +1,30 @@
 #include <vector>
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <deque>
+#include <set>
+#include <tuple>
+#include <cassert>
 
 #include "sov.hpp"
+#include "sov_sweep.hpp"
+#include "sov_cache.hpp"
+#include "sov_grad.hpp"
+#include "sov_spline.hpp"
+#include "sov_voxel.hpp"
 #include "rtcore/mesh.hpp"
 #include "visualize.hpp"
 #include "util.hpp"
 #include "pointset.hpp"
+#include "point_tree.hpp"
+#include "point_distance.hpp"
 #include "powell.hpp"
+#include "lbfgs.hpp"
 
 
 std::tuple<std::vector<Sphere>, std::vector<PointSet>>
@@ -25,12 +42,12 @@ std::tuple<std::vector<Sphere>, std::vector<PointSet>>
 	PointSet psorted;
 	{
 		std::vector<std::pair<double, vec3f>> ps;
-		for (auto p: points) {
-			double minsqrdist = INF;
-			for (auto c: center)
-				minsqrdist = std::min(minsqrdist, sqrlen(c - p));
-			ps.push_back({minsqrdist, p});
-		}
+		PointSoA centers;
+		for (auto c: center)
+			centers.push_back(c);
+		std::vector<double> minsqrdist = min_sqrdist(PointSoA(points), centers);
+		for (int k=0; k<points.size(); ++k)
+			ps.push_back({minsqrdist[k], points[k]});
 		std::sort(ps.begin(), ps.end(), [](const std::pair<double, vec3f>& a, const std::pair<double, vec3f>& b){return a.first < b.first;});
 		for (auto pair: ps)
 			psorted.push_back(pair.second);
@@ -82,94 +99,301 @@ std::tuple<std::vector<Sphere>, std::vector<PointSet>>
 }
 
 
+// loss of spheres sharing one center, as a function of radius
+// queried with non-decreasing radii
+typedef std::function<double(double)> RadialLoss;
+
+// estimate of a RadialLoss, writing the width of its error band to err
+typedef std::function<double(double, double&)> RadialEstimate;
+
+// upcoming points each of n centers' nearest-first lists may hold within mem_cap bytes, 0 (unbounded) if mem_cap is 0
+int nearest_cap(size_t mem_cap, int n)
+{
+	if (mem_cap == 0) return 0;
+	return std::max((size_t)1, mem_cap / (n * PointTree::Nearest::item_bytes));
+}
+
+// losses of different centers are evaluated in parallel, so radial_loss & the functions it returns
+// must be safe to call from several threads (each function from one thread at a time)
+// lookahead: number of next candidate points of a center whose loss is evaluated at once, ahead of need.
+//   With lookahead 1 each center's loss is queried exactly as in a serial run. With more, radii of
+//   points assigned to other centers meanwhile are queried too, so the result is the same as long as
+//   loss depends on radius only (SOVSweep does, its sums run in an order independent of the radii queried)
+// mem_cap: if positive, bytes allowed for the nearest-first lists of all centers, which otherwise grow
+//   with the unassigned points at the border of the ball each center has reached. Besides them, memory
+//   is linear in the number of points.
+//   The result doesn't depend on it.
+// peak_bytes: if given, set to the peak memory held by the assignment, except the loss functions
+// radial_estimate: if given, losses are estimated by the functions it returns (same requirements as radial_loss),
+//   and exact loss is evaluated only where error bands of estimates can't tell the best center apart
+//   (loss already accumulated by a center is taken as is, whether estimated or exact)
 std::tuple<std::vector<Sphere>, std::vector<PointSet>>
-	points_assign(const std::vector<vec3f>& center, const PointSet& points, std::function<double(Sphere)> loss)
+	points_assign(const std::vector<vec3f>& center, const PointSet& points, std::function<RadialLoss(vec3f)> radial_loss, int lookahead = 1,
+		size_t mem_cap = 0, size_t* peak_bytes = NULL, std::function<RadialEstimate(vec3f)> radial_estimate = nullptr)
 {
 	// initialize
 	const int n = center.size();
+	const bool estimated = (radial_estimate != nullptr);
 	std::vector<Sphere> sphere;
 	std::vector<double> curloss(n,0);
 	std::vector<PointSet> cluster(n);
-	std::vector<bool> assigned(points.size(), false);
-	std::vector<std::vector<int>> psorted; // indices of sorted points
-	std::vector<std::vector<int>::iterator> pcur(n);
+	// points of each center nearest first, assigned ones are removed
+	PointTree tree(points);
+	std::vector<PointTree::Nearest> nearest;
+	std::vector<RadialLoss> loss(n);
+	std::vector<RadialEstimate> estimate(n);
+	threadpool.run(n, [&](int i){
+		loss[i] = radial_loss(center[i]);
+		if (estimated)
+			estimate[i] = radial_estimate(center[i]);
+	});
+	int cap = nearest_cap(mem_cap, n);
 	for (int i=0; i<n; ++i) {
 		sphere.push_back(Sphere(center[i], 0));
-		// sort points by distance
-		psorted.push_back(std::vector<int>(points.size()));
-		std::iota(psorted[i].begin(), psorted[i].end(), 0);
-		auto cmp = [&](int a, int b){
-			return sqrlen(points[a] - center[i]) < sqrlen(points[b] - center[i]);
-		};
-		std::sort(psorted[i].begin(), psorted[i].end(), cmp);
-		pcur[i] = psorted[i].begin();
+		nearest.push_back(tree.nearest(center[i], cap));
 	}
-	std::vector<double> nextloss(n);
+	// upcoming point of a center with its loss & error band of the loss (0 if it's exact)
+	struct Upcoming
+	{
+		int p;
+		double loss, err;
+	};
+	// upcoming points of each center, the first one unassigned is its next candidate
+	std::vector<std::deque<Upcoming>> ahead(n);
+	// bytes held per center by nearest & ahead, and in total
+	std::vector<size_t> held(n, 0);
+	size_t held_sum = 0;
+	// drops assigned points from ahead of centers in list, refilling the ones left empty in parallel
+	auto advance = [&](const std::vector<int>& list) {
+		std::vector<int> refill;
+		for (int i: list) {
+			while (!ahead[i].empty() && tree.removed(ahead[i].front().p))
+				ahead[i].pop_front();
+			if (ahead[i].empty())
+				refill.push_back(i);
+		}
+		threadpool.run(refill.size(), [&](int k){
+			int i = refill[k];
+			for (int m=0; m<lookahead; ++m) {
+				int p = nearest[i].next();
+				if (p < 0) break;
+				double r = norm(points[p] - center[i]), err = 0;
+				ahead[i].push_back({p, estimated? estimate[i](r, err): loss[i](r), err});
+			}
+		});
+		for (int i: list) {
+			size_t h = nearest[i].bytes() + ahead[i].size() * sizeof(Upcoming);
+			held_sum += h - held[i];
+			held[i] = h;
+		}
+	};
+	// candidates (increment in loss, center, version) in a heap, smallest increment first,
+	// ties broken by smaller center index. entries of older versions are stale & skipped
+	typedef std::tuple<double, int, int> Candidate;
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+	std::vector<int> version(n, 0);
+	// with estimates, lower ends of error bands of candidates (lower, center), ascending
+	std::set<std::pair<double,int>> band;
+	std::vector<double> lower(n, INF);
+	auto enqueue = [&](int i) {
+		version[i]++;
+		if (estimated) {
+			band.erase({lower[i], i});
+			lower[i] = INF;
+		}
+		if (ahead[i].empty())
+			return;
+		const Upcoming& u = ahead[i].front();
+		heap.push({u.loss - curloss[i], i, version[i]});
+		if (estimated) {
+			lower[i] = u.loss - curloss[i] - u.err;
+			band.insert({lower[i], i});
+		}
+	};
+	// centers whose next point is p, so that only they are updated once p is assigned:
+	// linked lists starting at waiting[p], continued by next_waiting[center], ended by -1
+	std::vector<int> waiting(points.size(), -1), next_waiting(n, -1);
+	auto push = [&](int i) {
+		enqueue(i);
+		if (ahead[i].empty())
+			return;
+		int p = ahead[i].front().p;
+		next_waiting[i] = waiting[p];
+		waiting[p] = i;
+	};
+	auto pop_stale = [&]() {
+		while (!heap.empty() && std::get<2>(heap.top()) != version[std::get<1>(heap.top())])
+			heap.pop();
+	};
+	// memory held besides the clusters, which grow to a copy of points
+	auto footprint = [&]() {
+		return tree.bytes() + (waiting.size() + n) * sizeof(int) + held_sum
+			+ heap.size() * sizeof(Candidate) + n * (sizeof(Sphere) + sizeof(PointSet) + 2 * sizeof(int) + sizeof(double))
+			+ band.size() * (sizeof(std::pair<double,int>) + 4 * sizeof(void*));
+	};
+	size_t peak = 0;
+	std::vector<int> all(n);
+	std::iota(all.begin(), all.end(), 0);
+	advance(all);
 	for (int i=0; i<n; ++i)
-		nextloss[i] = loss(Sphere(center[i], norm(points[*pcur[i]] - center[i])));
+		push(i);
 	// assign all points
 	for (int _=0; _<points.size(); ++_)
 	{
-		// if (_ % 100 == 0) console.log("_",_);
 		// find point-center pair of minimum increment in loss function
-		int best = 0;
-		double bestdelta = nextloss[best] - curloss[best];
-		for (int i=1; i<n; ++i) {
-			double t = nextloss[i] - curloss[i];
-			if (t < bestdelta) {
-				bestdelta = t;
-				best = i;
-			}
+		pop_stale();
+		// stale entries are otherwise dropped only on top, keep the heap within twice the centers
+		if (heap.size() > 2 * n + 16) {
+			std::vector<Candidate> valid;
+			for (; !heap.empty(); heap.pop())
+				if (std::get<2>(heap.top()) == version[std::get<1>(heap.top())])
+					valid.push_back(heap.top());
+			heap = decltype(heap)(std::greater<Candidate>(), std::move(valid));
 		}
-		assert(!isinf(bestdelta));
-		// add this point to corresponding cluster
-		cluster[best].push_back(points[*pcur[best]]);
-		sphere[best].radius = norm(points[*pcur[best]] - center[best]);
-		curloss[best] = nextloss[best];
-		assigned[*pcur[best]] = true;
-		// update pcur so that they all point to unassigned points
-		for (int i=0; i<n; ++i) {
-			bool recompute = false;
-			while (pcur[i] != psorted[i].end() && assigned[*pcur[i]]) {
-				recompute = true;
-				pcur[i]++;
-			}
-			if (recompute) {
-				if (pcur[i] == psorted[i].end())
-					nextloss[i] = INF;
-				else
-					nextloss[i] = loss(Sphere(center[i], norm(points[*pcur[i]] - center[i])));
-			}
+		// with estimates, evaluate exactly the ones whose error band overlaps with that of the best
+		while (estimated) {
+			assert(!heap.empty());
+			int best = std::get<1>(heap.top());
+			double upper = std::get<0>(heap.top()) + ahead[best].front().err;
+			// contenders: other centers whose band reaches below upper end of the best's band
+			bool overlap = false;
+			std::vector<int> contender;
+			for (auto it = band.begin(); it != band.end() && it->first < upper; ++it)
+				if (it->second != best) {
+					overlap = true;
+					if (ahead[it->second].front().err > 0)
+						contender.push_back(it->second);
+				}
+			if (!overlap) break;
+			if (ahead[best].front().err > 0)
+				contender.push_back(best);
+			if (contender.empty()) break;
+			threadpool.run(contender.size(), [&](int k){
+				int i = contender[k];
+				Upcoming& u = ahead[i].front();
+				u.loss = loss[i](norm(points[u.p] - center[i]));
+				u.err = 0;
+			});
+			for (int i: contender)
+				enqueue(i);
+			pop_stale();
 		}
+		peak = std::max(peak, footprint());
+		assert(!heap.empty());
+		int best = std::get<1>(heap.top());
+		heap.pop();
+		// add this point to corresponding cluster
+		int p = ahead[best].front().p;
+		cluster[best].push_back(points[p]);
+		sphere[best].radius = norm(points[p] - center[best]);
+		curloss[best] = ahead[best].front().loss;
+		tree.remove(p);
+		// move centers waiting on p to their next unassigned point
+		std::vector<int> moved;
+		for (int i=waiting[p]; i>=0; i=next_waiting[i])
+			moved.push_back(i);
+		waiting[p] = -1;
+		advance(moved);
+		for (int i: moved)
+			push(i);
+	}
+	if (peak_bytes) {
+		*peak_bytes = std::max(peak, footprint());
+		for (auto& c: cluster)
+			*peak_bytes += c.capacity() * sizeof(vec3f);
 	}
 	return {sphere, cluster};
 }
 
-Sphere sphere_fit(const Sphere& initial, const PointSet& points, std::function<double(Sphere)> loss)
+// points_assign() with loss of radius estimated by SOVSpline of relative tolerance tol
+// n_exact: if given, number of exact loss evaluations is added to it
+// other parameters as in points_assign()
+std::tuple<std::vector<Sphere>, std::vector<PointSet>>
+	points_assign_spline(const std::vector<vec3f>& center, const PointSet& points, std::function<double(Sphere)> loss, double tol, long long* n_exact = NULL,
+		int lookahead = 1, size_t mem_cap = 0, size_t* peak_bytes = NULL)
+{
+	PointSoA soa(points);
+	std::atomic<long long> n_eval{0};
+	auto radial_loss = [&](vec3f o) -> RadialLoss {
+		return [&, o](double r){
+			n_eval++;
+			return loss(Sphere(o, r));
+		};
+	};
+	auto radial_estimate = [&](vec3f o) -> RadialEstimate {
+		double rmax;
+		farthest(soa, o, &rmax);
+		auto spline = std::make_shared<SOVSpline>([&](double r){return loss(Sphere(o, r));}, std::sqrt(rmax), tol);
+		n_eval += spline->samples();
+		return [spline](double r, double& err){
+			err = spline->error(r);
+			return (*spline)(r);
+		};
+	};
+	auto result = points_assign(center, points, radial_loss, lookahead, mem_cap, peak_bytes, radial_estimate);
+	if (n_exact) *n_exact += n_eval;
+	return result;
+}
+
+// n_eval: if given, number of loss evaluations is added to it
+Sphere sphere_fit(const Sphere& initial, const PointSet& points, std::function<double(Sphere)> loss, long long* n_eval = NULL)
 {
 	// function to optimize
 	if (initial.radius == 0)
 		return initial;
+	PointSoA soa(points);
+	auto radius = [&](vec3f o){
+		double r2;
+		farthest(soa, o, &r2);
+		return std::sqrt(r2);
+	};
 	auto target = [&](vec3f o){
-		double r = 0;
-		for (auto p: points)
-			r = std::max(r, norm(p-o));
-		return loss(Sphere(o,r));
+		if (n_eval) (*n_eval)++;
+		return loss(Sphere(o, radius(o)));
 	};
-	Sphere sphere(optimize(initial.center, target), 0);
-	for (auto p: points)
-		sphere.radius = std::max(sphere.radius, norm(p-sphere.center));
-	return sphere;
+	vec3f o = optimize(initial.center, target);
+	return Sphere(o, radius(o));
+}
+
+// loss of sphere, also writing its partial derivatives w.r.t. center & radius
+typedef std::function<double(Sphere, vec3f&, double&)> LossGrad;
+
+// same as sphere_fit, using gradient-based L-BFGS instead of Powell's method
+Sphere sphere_fit_lbfgs(const Sphere& initial, const PointSet& points, LossGrad loss, long long* n_eval = NULL)
+{
+	if (initial.radius == 0)
+		return initial;
+	PointSoA soa(points);
+	auto target = [&](vec3f o, vec3f& grad){
+		double r2;
+		int pfar = farthest(soa, o, &r2);
+		double r = std::sqrt(r2);
+		vec3f grad_o;
+		double grad_r;
+		if (n_eval) (*n_eval)++;
+		double f = loss(Sphere(o,r), grad_o, grad_r);
+		// radius follows the farthest point
+		grad = grad_o;
+		if (r > 0)
+			grad += grad_r * (o - points[pfar]) / r;
+		return f;
+	};
+	vec3f o = optimize_lbfgs(initial.center, target, 0.1 * initial.radius);
+	// check if we have really done at least some optimization
+	vec3f g;
+	if (target(o, g) > target(initial.center, g))
+		o = initial.center;
+	double r2;
+	farthest(soa, o, &r2);
+	return Sphere(o, std::sqrt(r2));
 }
 
 void checkContain(const Sphere& s, const PointSet& points)
 {
-	for (auto p: points) {
-		if (sqrlen(p - s.center) > s.radius * s.radius * (1+1e-5)) {
-			console.warn("check contain failed");
-			return;
-		}
-	}
+	double r2;
+	farthest(PointSoA(points), s.center, &r2);
+	if (r2 > s.radius * s.radius * (1+1e-5))
+		console.warn("check contain failed");
 }
 
 
@@ -207,11 +431,126 @@ void teleport_n(std::vector<Sphere>& sphere, std::vector<PointSet>& points, std:
 	*to_split = Sphere(p2, 0);
 }
 
-std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, const RTcore::Mesh& manifold, int ns, int ninner, int nsurface, int n_finalsample, int n_mutate)
+enum FitMode
+{
+	FIT_POWELL,
+	FIT_LBFGS,
+};
+
+// cache_mb: memory cap of cached loss values in MiB
+// fit_mode: optimizer of step 2
+// fit_compare: also run Powell's method in L-BFGS mode, reporting evaluations saved
+// assign_tol: if positive, point assignment uses SOVSpline of this relative tolerance instead of exact loss
+// voxel_res: if positive, loss is approximated by SOVGrid of this resolution until it stops improving
+// sov_tol: absolute tolerance of each loss evaluation, see sov()
+// lookahead: number of candidate points per center evaluated at once in point assignment, see points_assign()
+// assign_mb: if positive, memory cap of nearest-first lists in point assignment in MiB, reporting peak memory of each assignment
+//   (SOVSweep state of each center, linear in the triangles it has reached, is counted but not capped)
+std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, const RTcore::Mesh& manifold, int ns, int ninner, int nsurface, int n_finalsample, int n_mutate, int cache_mb, FitMode fit_mode, bool fit_compare, double assign_tol, int voxel_res, double sov_tol, int lookahead, int assign_mb)
 {
 	double bestsumloss = INF;
 	std::vector<Sphere> bestresult;
-	auto loss = [&](Sphere s){return sov(manifold,s);};
+	TriangleSoA manifold_soa(manifold);
+	SOVCache cached_sov([&](Sphere s){return sov(manifold,manifold_soa,s,sov_tol);}, (size_t)cache_mb << 20);
+	// coarse: loss is approximated by grid, switched off once it stops improving
+	std::unique_ptr<SOVGrid> grid;
+	if (voxel_res > 0) {
+		console.time("voxelization");
+		grid = std::make_unique<SOVGrid>(manifold, voxel_res);
+		console.timeEnd("voxelization");
+	}
+	bool coarse = (grid != NULL);
+	auto loss = [&](Sphere s){return coarse? (*grid)(s): cached_sov(s);};
+	// loss of many spheres, evaluating the ones not cached in one batch
+	auto loss_batch = [&](const std::vector<Sphere>& spheres) {
+		std::vector<double> value(spheres.size());
+		if (coarse) {
+			for (int i=0; i<spheres.size(); ++i)
+				value[i] = (*grid)(spheres[i]);
+			return value;
+		}
+		std::vector<Sphere> miss;
+		std::vector<int> miss_index;
+		for (int i=0; i<spheres.size(); ++i)
+			if (!cached_sov.find(spheres[i], value[i])) {
+				miss.push_back(spheres[i]);
+				miss_index.push_back(i);
+			}
+		std::vector<double> computed = sov(manifold, manifold_soa, miss, sov_tol);
+		for (int j=0; j<miss.size(); ++j) {
+			value[miss_index[j]] = computed[j];
+			cached_sov.insert(miss[j], computed[j]);
+		}
+		return value;
+	};
+	// same value as loss, which is then cached for it
+	auto loss_grad = [&](Sphere s, vec3f& grad_o, double& grad_r) {
+		double value = sov(manifold, manifold_soa, s.center, s.radius, grad_o, grad_r, sov_tol);
+		cached_sov.insert(s, value);
+		return value;
+	};
+	auto fit = [&](int i, const Sphere& initial, const PointSet& points) {
+		if (fit_mode == FIT_POWELL || coarse) // no gradient of coarse loss
+			return sphere_fit(initial, points, loss);
+		long long n_lbfgs = 0, n_powell = 0;
+		Sphere s = sphere_fit_lbfgs(initial, points, loss_grad, &n_lbfgs);
+		if (fit_compare) {
+			Sphere s_powell = sphere_fit(initial, points, loss, &n_powell);
+			console.log("  fit of cluster", i, ":", n_lbfgs, "evaluations, Powell", n_powell, "( saved", n_powell - n_lbfgs, ")",
+				" loss:", loss(s), "Powell", loss(s_powell));
+		}
+		return s;
+	};
+	// fits of clusters are independent & run in parallel (their SOV evaluations then run serially),
+	// largest clusters first so that no long fit is started last while the other threads idle.
+	// They share only the SOV cache, whose values all come from sov() or its batch & gradient versions,
+	// bit-identical to it for any number of threads, so neither the order threads fill it in nor LRU
+	// eviction changes results
+	auto fit_all = [&](std::vector<Sphere>& sphere, const std::vector<PointSet>& points) {
+		std::vector<int> order(sphere.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b){return points[a].size() > points[b].size();});
+		threadpool.run(order.size(), [&](int k){
+			int i = order[k];
+			sphere[i] = fit(i, sphere[i], points[i]);
+		});
+	};
+	// sweeps of the running assignment, kept to count their memory
+	std::vector<std::shared_ptr<SOVSweep>> sweeps;
+	std::mutex sweeps_mutex;
+	auto radial_loss = [&](vec3f o) -> RadialLoss {
+		if (coarse)
+			return [&grid, o](double r){return (*grid)(Sphere(o,r));};
+		auto sweep = std::make_shared<SOVSweep>(manifold, manifold_soa, o);
+		if (assign_mb > 0) {
+			std::lock_guard<std::mutex> lock(sweeps_mutex);
+			sweeps.push_back(sweep);
+		}
+		return [sweep](double r){return (*sweep)(r);};
+	};
+	auto assign = [&](const std::vector<vec3f>& center, const PointSet& points) {
+		size_t mem_cap = (size_t)assign_mb << 20;
+		if (assign_tol <= 0 || coarse) {
+			size_t peak;
+			auto result = points_assign(center, points, radial_loss, lookahead, mem_cap, &peak);
+			if (assign_mb > 0) {
+				// radii of each center only grow, so sweeps hold the most at the end
+				size_t sweep_bytes = 0;
+				for (auto& sweep: sweeps)
+					sweep_bytes += sweep->bytes();
+				sweeps.clear();
+				console.log("  assignment: peak memory", (peak + sweep_bytes) / double(1 << 20), "MiB, SOV sweeps", sweep_bytes / double(1 << 20), "MiB of it");
+			}
+			return result;
+		}
+		long long n_exact = 0;
+		size_t peak;
+		auto result = points_assign_spline(center, points, loss, assign_tol, &n_exact, lookahead, mem_cap, &peak);
+		console.log("  assignment:", n_exact, "exact SOV evaluations");
+		if (assign_mb > 0)
+			console.log("  assignment: peak memory", peak / double(1 << 20), "MiB");
+		return result;
+	};
 	// sample points
 	console.log("initializing...  ns:",ns);
 	PointSet innerpoints = get_inner_points(manifold, ninner);
@@ -220,8 +559,9 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 
 	auto checkresult = [&](const std::vector<Sphere>& sphere){
 		double sumloss = 0;
+		std::vector<double> losses = loss_batch(sphere);
 		for (int i=0; i<ns; ++i)
-			sumloss += loss(sphere[i]);
+			sumloss += losses[i];
 		console.log("TOTAL LOSS:", sumloss);
 		if (sumloss < 0) {
 			console.warn("NEGATIVE LOSS!");
@@ -243,14 +583,13 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 	};
 	auto step1 = [&](std::vector<vec3f> center) {
 		console.time("point assignment");
-		auto [sphere, points] = points_assign(center, concat(innerpoints, surfacepoints), loss);
+		auto [sphere, points] = assign(center, concat(innerpoints, surfacepoints));
 		console.timeEnd("point assignment");
 		return std::make_tuple(sphere, points);
 	};
 	auto step2 = [&](std::vector<Sphere> sphere, std::vector<PointSet> points) {
 		console.time("sphere fit");
-		for (int i=0; i<ns; ++i)
-			sphere[i] = sphere_fit(sphere[i], points[i], loss);
+		fit_all(sphere, points);
 		console.timeEnd("sphere fit");
 		return std::make_tuple(sphere, points);
 	};
@@ -300,6 +639,13 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 				points = points2;
 				i = 1; // next step: step1
 			}
+			else if (coarse) {
+				console.info("switching to exact loss...");
+				coarse = false;
+				bestsumloss = INF; // losses so far aren't comparable
+				curloss = checkresult(sphere);
+				i = 1; // next step: step1
+			}
 			else {
 				if (risecnt < n_mutate) {
 					curloss = loss2;
@@ -317,16 +663,15 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 	}
 	// final iteration
 	points = std::vector<PointSet>(ns);
-	for (auto p: concat(innerpoints, surfacepoints)) {
-		bool acc = false;
-		for (int i=0; i<ns; ++i)
-			if (norm(p - bestresult[i].center) <= bestresult[i].radius)
-			{
-				acc = true;
-				points[i].push_back(p);
-				break;
-			}
-		if (not acc) console.warn("final allocation failed");
+	{
+		PointSet allpoints = concat(innerpoints, surfacepoints);
+		std::vector<int> within = first_within(PointSoA(allpoints), bestresult);
+		for (int k=0; k<allpoints.size(); ++k) {
+			if (within[k] >= 0)
+				points[within[k]].push_back(allpoints[k]);
+			else
+				console.warn("final allocation failed");
+		}
 	}
 	console.info("final iteration...");
 	curloss = checkresult(bestresult);
@@ -346,17 +691,22 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 	visualize(bestresult);
 	console.info("final expanding to cover all triangles...");
 	PointSet finalpoints = get_surface_points(originalmesh, n_finalsample);
+	PointSoA finalcenter;
+	std::vector<double> finalradius;
+	for (auto& s: bestresult) {
+		finalcenter.push_back(s.center);
+		finalradius.push_back(s.radius);
+	}
 	for (auto p: finalpoints) {
-		auto iter = argmax(bestresult, [&](Sphere s){
-			return -std::max(0.0,norm(p-s.center)-s.radius);});
-		iter->radius = std::max(iter->radius, norm(p - iter->center));
-		points[iter - bestresult.begin()].push_back(p);
+		int i = min_excess(finalcenter, finalradius, p);
+		bestresult[i].radius = std::max(bestresult[i].radius, norm(p - bestresult[i].center));
+		finalradius[i] = bestresult[i].radius;
+		points[i].push_back(p);
 	}
 	checkresult(bestresult);
-	for (int i=0; i<ns; ++i) {
+	for (int i=0; i<ns; ++i)
 		checkContain(bestresult[i], points[i]);
-		bestresult[i] = sphere_fit(bestresult[i], points[i], loss);
-	}
+	fit_all(bestresult, points);
 	curloss = checkresult(bestresult);
 	visualize(bestresult);
 	PointSet allpoints;
@@ -364,7 +714,7 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 		allpoints = concat(allpoints, p);
 	while (true) {
 		console.time("point assignment");
-		auto [s1, p1] = points_assign(getcenter(bestresult), allpoints, loss);
+		auto [s1, p1] = assign(getcenter(bestresult), allpoints);
 		console.timeEnd("point assignment");
 		auto [sphere1, points1] = step2(s1, p1);
 		double loss1 = checkresult(sphere1);
@@ -378,5 +728,9 @@ std::vector<Sphere> sphere_set_approximate(const RTcore::Mesh& originalmesh, con
 		}
 	}
 	visualize(bestresult);
+	console.info("SOV cache:", cached_sov.hits(), "hits,", cached_sov.misses(), "misses");
+	if (sotv_stats.total() > 0)
+		console.warn("SOTV degenerate cases:", sotv_stats.tangent, "tangent,", sotv_stats.nonfinite, "non-finite,",
+			sotv_stats.zero_sign, "zero sign");
 	return bestresult;
 }
@@ -0,0 +1,127 @@
+// fixed pool of worker threads running parallel loops
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+
+class ThreadPool
+{
+	struct Job {
+		std::function<void(int)> f;
+		int n;
+		std::atomic<int> next{0};
+		std::atomic<int> done{0};
+	};
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable cv_job, cv_done;
+	std::shared_ptr<Job> job;
+	long long generation = 0;
+	bool stopping = false;
+	std::mutex run_mtx; // one loop at a time
+	static thread_local bool in_worker;
+
+public:
+	ThreadPool(int n_threads = 1)
+	{
+		resize(n_threads);
+	}
+
+	~ThreadPool()
+	{
+		stop();
+	}
+
+	// number of threads taking part in a loop, including the calling thread
+	void resize(int n_threads)
+	{
+		stop();
+		stopping = false;
+		for (int i=1; i<n_threads; ++i)
+			workers.emplace_back([this]{ work(); });
+	}
+
+	int size() const
+	{
+		return workers.size() + 1;
+	}
+
+	// runs f(0), ..., f(n-1) in parallel and waits for all of them
+	// calls from inside a running loop are executed serially by the calling thread
+	void run(int n, std::function<void(int)> f)
+	{
+		if (in_worker || workers.empty() || n <= 1) {
+			for (int i=0; i<n; ++i)
+				f(i);
+			return;
+		}
+		std::lock_guard<std::mutex> run_lock(run_mtx);
+		auto cur = std::make_shared<Job>();
+		cur->f = f;
+		cur->n = n;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			job = cur;
+			generation++;
+		}
+		cv_job.notify_all();
+		in_worker = true;
+		execute(*cur);
+		in_worker = false;
+		std::unique_lock<std::mutex> lock(mtx);
+		cv_done.wait(lock, [&]{ return cur->done == cur->n; });
+		job = NULL;
+	}
+
+private:
+	void execute(Job& j)
+	{
+		for (int i; (i = j.next++) < j.n; ) {
+			j.f(i);
+			if (++j.done == j.n) {
+				std::lock_guard<std::mutex> lock(mtx);
+				cv_done.notify_all();
+			}
+		}
+	}
+
+	void work()
+	{
+		in_worker = true;
+		long long seen = 0;
+		while (true) {
+			std::shared_ptr<Job> cur;
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv_job.wait(lock, [&]{ return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				cur = job;
+			}
+			if (cur) execute(*cur);
+		}
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stopping = true;
+		}
+		cv_job.notify_all();
+		for (auto& t: workers)
+			t.join();
+		workers.clear();
+	}
+};
+
+thread_local bool ThreadPool::in_worker = false;
+
+// shared by all parallel loops of the program, sized by command line
+ThreadPool threadpool;
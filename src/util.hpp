@@ -33,6 +33,22 @@ std::vector<T> concat(const std::vector<T>& a, const std::vector<T>& b)
     return ab;
 }
 
+// sum of a[l..r-1] by recursive halving: fixed order, error growing with log of size
+template<typename T>
+T pairwise_sum(const std::vector<T>& a, int l, int r)
+{
+	if (r <= l) return T(0);
+	if (r - l == 1) return a[l];
+	int m = l + (r-l)/2;
+	return pairwise_sum(a, l, m) + pairwise_sum(a, m, r);
+}
+
+template<typename T>
+T pairwise_sum(const std::vector<T>& a)
+{
+	return pairwise_sum(a, 0, a.size());
+}
+
 template<typename T>
 T average(const std::vector<T>& a)
 {
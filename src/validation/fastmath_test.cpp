@@ -0,0 +1,93 @@
+
+// test fast math mode of sotv against the exact path
+// g++ -std=c++17 -O3 -I.. fastmath_test.cpp ../math/vecmath.cpp
+
+#include <vector>
+#include <ctime>
+#include "lib/consolelog.hpp"
+#include "math/fastmath.hpp"
+#include "sotv.hpp"
+
+double rnd()
+{
+	return (double)rand()/RAND_MAX*10-5;
+}
+
+int main()
+{
+	srand(time(0));
+
+	// inverse trigonometric functions, absolute error
+	double err_atan2 = 0, err_asin = 0, err_acos = 0;
+	for (int i=0; i<1000000; ++i)
+	{
+		double y = rnd(), x = rnd();
+		if (i % 4 == 0) y *= 1e-6;
+		if (i % 4 == 1) x *= 1e-6;
+		err_atan2 = std::max(err_atan2, std::abs(fast_atan2(y,x) - std::atan2(y,x)));
+		double u = (double)rand()/RAND_MAX*2-1;
+		err_asin = std::max(err_asin, std::abs(fast_asin(u) - std::asin(u)));
+		err_acos = std::max(err_acos, std::abs(fast_acos(u) - std::acos(u)));
+	}
+	console.log("max abs error  atan2:", err_atan2, " asin:", err_asin, " acos:", err_acos);
+	if (std::max({err_atan2, err_asin, err_acos}) > 1e-10)
+		console.error("error: inverse trigonometric functions exceed 1e-10");
+
+	// sotv, error relative to sphere volume
+	double err_sotv = 0;
+	int n_case = 0;
+	for (int i=0; i<1000000; ++i)
+	{
+		vec3f o(rnd(),rnd(),rnd());
+		double r = std::abs(rnd());
+		vec3f a = o + vec3f(rnd(),rnd(),rnd());
+		vec3f b = o + vec3f(rnd(),rnd(),rnd());
+		vec3f c = o + vec3f(rnd(),rnd(),rnd());
+		double exact, fast;
+		try {
+			SOTV::fast_math = false;
+			exact = sotv(a,b,c,o,r);
+			SOTV::fast_math = true;
+			fast = sotv(a,b,c,o,r);
+		}
+		catch (const char* e) {
+			continue;
+		}
+		n_case++;
+		double err = std::abs(fast - exact) / (4.0/3*PI * r*r*r);
+		if (err > err_sotv) {
+			err_sotv = err;
+			if (err > 1e-8) {
+				console.error("error: sotv exceeds 1e-8 of sphere volume");
+				console.info("exact", exact, "fast", fast);
+				console.info('a',a);
+				console.info('b',b);
+				console.info('c',c);
+				console.info('o',o);
+				console.info('r',r);
+			}
+		}
+	}
+	console.log("max sotv error / sphere volume:", err_sotv, "over", n_case, "cases");
+
+	// timing
+	std::vector<vec3f> a, b, c, o;
+	std::vector<double> r;
+	for (int i=0; i<200000; ++i) {
+		o.push_back(vec3f(rnd(),rnd(),rnd()));
+		r.push_back(std::abs(rnd()));
+		a.push_back(o.back() + vec3f(rnd(),rnd(),rnd()));
+		b.push_back(o.back() + vec3f(rnd(),rnd(),rnd()));
+		c.push_back(o.back() + vec3f(rnd(),rnd(),rnd()));
+	}
+	for (bool fast: {false, true}) {
+		SOTV::fast_math = fast;
+		double sum = 0;
+		clock_t t0 = clock();
+		for (int i=0; i<a.size(); ++i) {
+			try { sum += sotv(a[i],b[i],c[i],o[i],r[i]); }
+			catch (const char* e) {}
+		}
+		console.log(fast? "fast: ": "exact:", (double)(clock()-t0)/CLOCKS_PER_SEC, "s  sum", sum);
+	}
+}
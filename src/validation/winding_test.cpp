@@ -0,0 +1,65 @@
+// test inside/outside classification of sov() against the ray-casting test it replaced
+// g++ -std=c++17 -O3 -I.. winding_test.cpp ../math/vecmath.cpp ../rtcore/aabox.cpp -o winding_test
+// ./winding_test <closed mesh.obj>
+
+#include <vector>
+#include <ctime>
+#include "lib/consolelog.hpp"
+#include "rtcore/objmesh.hpp"
+#include "point_in_mesh.hpp"
+#include "sov.hpp"
+
+double rnd()
+{
+	return (double)rand()/RAND_MAX;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2) {
+		console.error("usage: winding_test <closed mesh.obj>");
+		return 1;
+	}
+	srand(time(0));
+	RTcore::Mesh mesh = RTcore::objmesh(argv[1]);
+	auto box = mesh.boundingVolume();
+	vec3f lo(box.x1, box.y1, box.z1), hi(box.x2, box.y2, box.z2);
+	double scale = norm(hi - lo);
+
+	// points all over the box, and points at decreasing distances off the surface,
+	// where far field approximation of subtrees near the surface matters most
+	std::vector<vec3f> points;
+	for (int i=0; i<4000; ++i) {
+		vec3f t(rnd(), rnd(), rnd());
+		points.push_back(lo - 0.2*(hi-lo) + 1.4 * vec3f(t.x*(hi.x-lo.x), t.y*(hi.y-lo.y), t.z*(hi.z-lo.z)));
+	}
+	for (double d: {1e-2, 1e-3, 1e-4})
+		for (int i=0; i<2000; ++i) {
+			const RTcore::Triangle* t = mesh.list[rand() % mesh.list.size()];
+			double u = rnd(), v = rnd();
+			if (u + v > 1) u = 1-u, v = 1-v;
+			vec3f p = t->v1 + u*(t->v2-t->v1) + v*(t->v3-t->v1);
+			points.push_back(p + (rand()%2? 1: -1) * d * scale * t->planeNormal);
+		}
+
+	double err_far = 0;
+	int n_undecided = 0, n_mismatch = 0;
+	for (vec3f p: points) {
+		double w = mesh.winding_number(p);
+		double exact = mesh.winding_number(p, true);
+		err_far = std::max(err_far, std::abs(w - exact));
+		if (std::abs(w - 0.5) < winding_margin)
+			n_undecided++;
+		bool inside = point_in_mesh(p, mesh);
+		if (inside_by_solid_angle(mesh, p, 4*PI * w) != inside) {
+			n_mismatch++;
+			console.error("error: classified", inside? "outside": "inside", "by winding number", w, "exact", exact);
+			console.info('p', p);
+		}
+	}
+	console.log("max far field error of winding number:", err_far, " margin:", winding_margin);
+	console.log(n_undecided, "of", points.size(), "points rechecked exactly,", n_mismatch, "mismatches against ray casting");
+	if (err_far >= winding_margin)
+		console.error("error: far field error exceeds margin");
+	return n_mismatch > 0;
+}